@@ -0,0 +1,44 @@
+/*
+ * DiskTest - aligned transfer buffers
+ */
+
+#include "bufferpool.h"
+#include "platform.h"
+#include <string.h>
+
+BufferPool::BufferPool() : base(NULL), count(0), slotSize(0), alignment(0) {
+}
+
+BufferPool::~BufferPool() {
+    Free();
+}
+
+bool BufferPool::Allocate(int slots, size_t size, size_t align) {
+    Free();
+
+    size_t page = (size_t)PageSize();
+    if (align < page) align = page;
+    size = (size + align - 1) / align * align;
+
+    base = (char*)AlignedAlloc(size * slots, align);
+    if (!base) return false;
+    // Touch every page now so faults don't land in the timed loop
+    memset(base, 0, size * slots);
+    count = slots;
+    slotSize = size;
+    alignment = align;
+    return true;
+}
+
+bool BufferPool::Fits(int slots, size_t size, size_t align) const {
+    return base && count >= slots && slotSize >= size && alignment % align == 0 &&
+           slotSize % align == 0;
+}
+
+void BufferPool::Free() {
+    if (base) AlignedFree(base);
+    base = NULL;
+    count = 0;
+    slotSize = 0;
+    alignment = 0;
+}
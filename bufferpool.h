@@ -0,0 +1,41 @@
+/*
+ * DiskTest - aligned transfer buffers
+ *
+ * One aligned allocation carved into equal slots, one per request in
+ * flight.  Unbuffered I/O needs buffers aligned to the device's logical
+ * block size, and page alignment also lets the kernel pin them cheaply, so
+ * the workers use this rather than std::vector<char>.
+ */
+
+#ifndef DISKTEST_BUFFERPOOL_H
+#define DISKTEST_BUFFERPOOL_H
+
+#include <stddef.h>
+
+class BufferPool {
+public:
+    BufferPool();
+    ~BufferPool();
+
+    // (Re)allocate count slots of at least slotSize bytes, each starting on
+    // an alignment boundary (at least a page).  Returns false if out of memory.
+    bool Allocate(int count, size_t slotSize, size_t alignment);
+    void Free();
+    // True if the pool already has count such slots, so need not be reallocated
+    bool Fits(int count, size_t slotSize, size_t alignment) const;
+
+    void* Slot(int index) const { return base + (size_t)index * slotSize; }
+    int Count() const { return count; }
+    size_t SlotSize() const { return slotSize; }
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    char* base;
+    int count;
+    size_t slotSize;
+    size_t alignment;
+};
+
+#endif // DISKTEST_BUFFERPOOL_H
@@ -1,34 +1,48 @@
 /*
- * DiskTest - Windows port of MS-DOS Disk performance tester
+ * DiskTest - Windows and Linux port of MS-DOS Disk performance tester
  * Originally by James Pearce, ported to Windows/Visual Studio 2019
  * 
  * For info on how to use it, see https://www.lo-tech.co.uk/wiki/DOS_Disk_Tester
  * 
- * IOMeter type performance tests for Windows PCs.
+ * IOMeter type performance tests for Windows and Linux PCs.
  * Used for the development of the Dangerous Prototype XT-IDE board, and
  * subsequently the lo-tech XT-CF board.
  * 
  * Includes pattern tests for testing interface reliability and
  * to generate patterns to check with a scope attached.
+ *
+ * File access goes through an IOEngine (see ioengine.h) and other OS
+ * services through platform.h, so the same tests run on both platforms.
  */
 
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
+#include "platform.h"
+#include "ioengine.h"
+#include "worker.h"
+#include "jobfile.h"
+#include "report.h"
+#include "verify.h"
+#include "pipeline.h"
+#include "errormap.h"
+#include "metadata.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <algorithm>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <vector>
-#include <conio.h>
 #include <stdarg.h>
 
-const char* VERSION = "2.5 (Windows)";
-const long DEFAULT_TEST_SIZE = 4194304; // 4MB
+const char* VERSION = "2.6";
+const long long DEFAULT_TEST_SIZE = 4194304; // 4MB
 const char* DEFAULT_FILENAME = "TEST$$$.FIL";
 const int DEFAULT_SEEKS = 256;
 const int PATTERN_TESTS = 10;
-const int DISPLAY_CODES_COUNT = 4;
-const char DISPLAY_CODES[4] = {'-', '\\', '|', '/'};
+const char* DEFAULT_MAPFILE = "disktest.map";
 
 // Pattern test modes
 const int PAT_READ = 1;
@@ -53,42 +67,127 @@ const char* PATTERN_NAMES[PATTERN_TESTS] = {
 
 const unsigned short POWER_PATTERNS[2] = {0x55AA, 0xAA55};
 
+// Blocks a pattern test covers, and where it picks up if resumed
+struct PatternRange {
+    long long first;      // First block of the area
+    long long writeFrom;  // First block to write (end to write none)
+    long long readFrom;   // First block to read back
+    long long end;        // One past the last block
+};
+
 // Global variables
-long TestSize = DEFAULT_TEST_SIZE;
+long long TestSize = DEFAULT_TEST_SIZE;
 char FName[256];
+bool Target = false;           // FName is an existing device or file from target=
+std::vector<std::string> TestFiles; // From paths=: a test file on each target, tested at once
+std::string PathList;          // The same, comma separated, for reports
 int Seeks = DEFAULT_SEEKS;
+char EngineName[32] = "";
+int QueueDepth = 1;
+int Threads = 1;
+bool FilePerThread = false;
+bool Direct = false;
+bool Prealloc = false;         // Allocate the test file before writing it
+bool Pipeline = false;         // Overlap media test IO with verification
+ErrorMap MediaErrors;          // Bad blocks and progress of the media test
+bool KeepTestFile = false;     // An interrupted media test will resume on it
+bool Permute = false;          // Random tests cover every block once
+DistributionSpec Distribution; // Or spread their offsets as dist= says
+unsigned long long Seed = 0;   // Random offsets, from seed= or the clock
+int SectorSize = 512; // Sector test transfer size and offset alignment
+int SeqBlockSize = 32768;      // Sequential test transfer size, from bs=
+int RandomBlockSize = 8192;    // Random test transfer size, from bs=
+WorkerBuffers Buffers;         // Transfer buffers reused by every test
+double RunTime = 0;            // Seconds per test, 0 to run by IO count
+double RampTime = 0;           // Warm-up seconds not counted
+double SteadyTolerance = 0;    // Percent, 0 to always run to the end
+double SteadyWindow = 5;       // Seconds
+double Rate = 0;               // Random test IOs per second from rate=, 0 for flat out
+double RateBytes = 0;          // Or bytes per second
+int SyncEvery = 0;             // Flush after every SyncEvery writes, from sync=
+bool SyncData = false;         // With fdatasync rather than fsync
+bool DSync = false;            // Open for writing with O_DSYNC
+bool GroupCommit = false;      // Threads on one file share flushes
+std::vector<WorkerStats> ThreadStats; // Per-thread results of the last test
+RunResult LastRun;
+std::vector<RunResult> GroupRuns; // With paths=, the last test's results per target
+Workload LastWorkload;
+Report Results;                // Every test, for output=
+char OutputFormat[8] = "";     // "json", "csv" or empty for text only
+char OutputFile[256] = "";
+FILE* ReportStream = NULL;     // Standard output, with outfile=-; the text goes to stderr
+FILE* IntervalLog = NULL;      // Per-interval results, from intervallog=
+double LogInterval = 0.1;      // Seconds per interval
 bool QUIT = false;
 bool noprogress = false;
-LARGE_INTEGER frequency;
-LARGE_INTEGER startTime;
+int ParamCount = 0;
+char** ParamValues = NULL;
 
 // Function declarations
-void StartClock();
-double StopClock();
+Workload TestWorkload();
+bool RunTest(const Workload& w);
+void RecordResult(const char* name);
+void CollectReportInfo();
+bool WriteResults();
 double CreateFile();
 double ReadTestFile();
 double RandomTest(int transfersize, int readpercent);
+void QueueDepthSweep(int readpercent);
+void RateSweep(int readpercent);
+void BlockSizeSweep(bool readonly, int readpercent);
+bool RunJobFile(const char* path, bool readonly);
+bool PrepareJobFile(const char* path, long long length);
+bool CheckJobFile(const char* path, long long length);
+bool MetadataTest();
+bool ReplayTest(bool readonly);
+void ShowThreadStats(bool iops);
+void ShowLatency();
+void MappedTests();
+bool CheckDirectIO(const char* path);
+bool OpenTarget(bool writes);
+bool ConfirmOverwrite();
+bool SetTestPaths(const char* list);
+std::vector<std::string> TestPaths();
 void PurgeTestFile();
 void DeleteTestFile();
-long CheckTestFile();
+long long CheckTestFile();
 void MediaTest();
+void RescanTest(const char* mapPath);
+void UniqueTest();
 void SignalTest();
+void VerifyBenchmark();
+bool SelfTest();
 bool ParamSpecified(const char* param);
 const char* GetParam(const char* param);
-long StringToValue(const char* s);
+long long StringToValue(const char* s);
+int ParseBlockSize(const char* s);
+std::string SizeName(long bytes);
 void ShowHelp();
-long GetDiskFreeSpace();
+long long GetDiskFreeSpace();
 
 int main(int argc, char* argv[]) {
-    printf("DiskTest, by James Pearce & Foone Turing. Windows Version %s\n", VERSION);
+    ParamCount = argc;
+    ParamValues = argv;
+    
+    // outfile=- pipes the report, so nothing else may go to standard output
+    if (ParamSpecified("output=") && ParamSpecified("outfile=") &&
+        strcmp(GetParam("outfile="), "-") == 0) {
+        ReportStream = SeparateStdout();
+        if (!ReportStream) {
+            fprintf(stderr, "Cannot separate the report from standard output\n");
+            return 1;
+        }
+    }
+    
+    printf("DiskTest, by James Pearce & Foone Turing. %s Version %s\n", PLATFORM_NAME, VERSION);
     
     // Initialize high-resolution timer
-    if (!QueryPerformanceFrequency(&frequency)) {
+    if (!InitClock()) {
         fprintf(stderr, "High-resolution timer not available\n");
         return 1;
     }
     
-    strcpy_s(FName, sizeof(FName), DEFAULT_FILENAME);
+    snprintf(FName, sizeof(FName), "%s", DEFAULT_FILENAME);
     
     // Check for help parameters
     if (ParamSpecified("/h") || ParamSpecified("-h") || 
@@ -102,25 +201,207 @@ int main(int argc, char* argv[]) {
     bool Readonly = ParamSpecified("readonly");
     noprogress = ParamSpecified("noprogress");
     
+    if (ParamSpecified("verifybench")) {
+        VerifyBenchmark();
+        return 0;
+    }
+    if (ParamSpecified("selftest")) return SelfTest() ? 0 : 1;
+    
+    // I/O engine and queue depth
+    if (ParamSpecified("engine=")) {
+        snprintf(EngineName, sizeof(EngineName), "%s", GetParam("engine="));
+    }
+    if (ParamSpecified("qd=")) {
+        QueueDepth = atoi(GetParam("qd="));
+        if (QueueDepth < 1 || QueueDepth > MAX_QUEUE_DEPTH) {
+            printf("Queue depth must be 1 to %d. Using 1.\n", MAX_QUEUE_DEPTH);
+            QueueDepth = 1;
+        }
+    }
+    
+    // Worker threads
+    if (ParamSpecified("threads=")) {
+        Threads = atoi(GetParam("threads="));
+        if (Threads < 1 || Threads > MAX_THREADS) {
+            printf("Threads must be 1 to %d. Using 1.\n", MAX_THREADS);
+            Threads = 1;
+        }
+    }
+    FilePerThread = Threads > 1 && ParamSpecified("perthreadfile");
+    if (ParamSpecified("target=")) {
+        snprintf(FName, sizeof(FName), "%s", GetParam("target="));
+        Target = true;
+        FilePerThread = false; // One device, shared by every thread
+    }
+    if (ParamSpecified("paths=")) {
+        if (Target || ParamSpecified("mediatest") || ParamSpecified("signaltest")) {
+            printf("paths= is for the performance tests, and cannot be used with target=.\n");
+            return 1;
+        }
+        if (!SetTestPaths(GetParam("paths="))) return 1;
+    }
+    Direct = ParamSpecified("direct");
+    Permute = ParamSpecified("permute");
+    Prealloc = ParamSpecified("prealloc");
+    Pipeline = ParamSpecified("pipeline");
+    {
+        MapOptions map = {MAP_ADVICE_NORMAL, ParamSpecified("populate"), ParamSpecified("mmaptouch")};
+        if (ParamSpecified("madvise=")) {
+            const char* advice = GetParam("madvise=");
+            if (_stricmp(advice, "sequential") == 0) {
+                map.advice = MAP_ADVICE_SEQUENTIAL;
+            } else if (_stricmp(advice, "random") == 0) {
+                map.advice = MAP_ADVICE_RANDOM;
+            } else if (_stricmp(advice, "willneed") == 0) {
+                map.advice = MAP_ADVICE_WILLNEED;
+            } else if (_stricmp(advice, "normal") != 0) {
+                printf("madvise= must be normal, sequential, random or willneed.\n");
+                return 1;
+            }
+        }
+        SetMapOptions(map);
+    }
+    Seed = ParamSpecified("seed=") ? strtoull(GetParam("seed="), NULL, 0)
+                                   : (unsigned long long)ClockNanos();
+    if (ParamSpecified("runtime=")) RunTime = atof(GetParam("runtime="));
+    if (ParamSpecified("ramp=")) RampTime = atof(GetParam("ramp="));
+    if (ParamSpecified("steady=")) SteadyTolerance = atof(GetParam("steady="));
+    if (ParamSpecified("steadywindow=")) SteadyWindow = atof(GetParam("steadywindow="));
+    if (ParamSpecified("output=")) {
+        snprintf(OutputFormat, sizeof(OutputFormat), "%s", GetParam("output="));
+        if (_stricmp(OutputFormat, "json") != 0 && _stricmp(OutputFormat, "csv") != 0) {
+            printf("output= must be json or csv.\n");
+            return 1;
+        }
+        if (ParamSpecified("outfile=")) {
+            snprintf(OutputFile, sizeof(OutputFile), "%s", GetParam("outfile="));
+        } else {
+            snprintf(OutputFile, sizeof(OutputFile), "disktest.%s",
+                     _stricmp(OutputFormat, "json") == 0 ? "json" : "csv");
+        }
+    }
+    if (ParamSpecified("bs=")) {
+        SeqBlockSize = RandomBlockSize = ParseBlockSize(GetParam("bs="));
+        if (SeqBlockSize == 0) {
+            printf("bs= must be a multiple of 512 up to %dM.\n", MAX_TRANSFER >> 20);
+            return 1;
+        }
+    }
+    if (ParamSpecified("rate=") && !ParseRate(GetParam("rate="), Rate, RateBytes)) {
+        printf("rate= must be IOs per second, or bytes per second with K, M or G (rate=50M).\n");
+        return 1;
+    }
+    if (ParamSpecified("dist=") && !ParseDistribution(GetParam("dist="), Distribution)) {
+        printf("dist= must be uniform, zipf:theta (zipf:0.99), hot:h:a (a%% of IOs to h%%\n");
+        printf("of the file, hot:10:90) or jitter:j (sequential, moved up to j blocks).\n");
+        return 1;
+    }
+    if (Permute && Distribution.kind != DIST_UNIFORM) {
+        printf("permute visits every block evenly, and cannot be used with dist=.\n");
+        return 1;
+    }
+    if (ParamSpecified("sync=")) {
+        SyncEvery = atoi(GetParam("sync="));
+        if (SyncEvery < 1) {
+            printf("sync= must be the number of writes between flushes.\n");
+            return 1;
+        }
+    }
+    SyncData = ParamSpecified("datasync");
+    DSync = ParamSpecified("dsync");
+    GroupCommit = ParamSpecified("groupcommit");
+    if ((SyncData || GroupCommit) && SyncEvery == 0) {
+        printf("datasync and groupcommit need sync=.\n");
+        return 1;
+    }
+    if (ParamSpecified("interval=")) LogInterval = atof(GetParam("interval=")) / 1000;
+    if (LogInterval <= 0) {
+        printf("interval= must be a positive number of milliseconds.\n");
+        return 1;
+    }
+    if (ParamSpecified("intervallog=")) {
+        const char* path = GetParam("intervallog=");
+        IntervalLog = fopen(path, "w");
+        if (!IntervalLog) {
+            printf("Cannot write interval log %s\n", path);
+            return 1;
+        }
+        WriteIntervalHeader(IntervalLog);
+    }
+    if (RunTime < 0 || RampTime < 0 || SteadyTolerance < 0 || SteadyWindow <= 0) {
+        printf("runtime=, ramp=, steady= and steadywindow= must be positive.\n");
+        return 1;
+    }
+    {
+        std::unique_ptr<IOEngine> probe(CreateEngine(EngineName, QueueDepth));
+        if (!probe) {
+            printf("I/O engine '%s' is not available on this platform.\n", EngineName);
+            return 1;
+        }
+        if (probe->QueueDepth() < QueueDepth) {
+            printf("The %s engine supports QD %d; random tests will run at that depth.\n",
+                   probe->Name(), probe->QueueDepth());
+            QueueDepth = probe->QueueDepth();
+        }
+    }
+    
+    // A job file asks before its first job that writes, if it has one
+    if (Target && !OpenTarget(!Readonly && !ParamSpecified("job="))) return 1;
+    
+    CollectReportInfo();
+    
+    // A job file replaces the built-in tests
+    if (ParamSpecified("job=")) {
+        bool ok = RunJobFile(GetParam("job="), Readonly);
+        return WriteResults() && ok ? 0 : 1;
+    }
+    
+    // So does the metadata test, which works on its own tree of small files
+    if (ParamSpecified("metatest")) {
+        if (Readonly || Target) {
+            printf("metatest creates files, and cannot be used with readonly or target=.\n");
+            return 1;
+        }
+        bool ok = MetadataTest();
+        return WriteResults() && ok ? 0 : 1;
+    }
+    
+    // And so does replaying a trace
+    if (ParamSpecified("replay=")) {
+        bool ok = ReplayTest(Readonly);
+        return WriteResults() && ok ? 0 : 1;
+    }
+    
     if (!Readonly) {
         TestDone = true;
         printf("Preparing drive...");
-        PurgeTestFile();
-        
-        // Check if specific test size was specified
-        if (ParamSpecified("size=")) {
-            TestSize = StringToValue(GetParam("size="));
-        }
+        // Resuming or rescanning a media test works on the existing file
+        bool reuse = ParamSpecified("mediatest") &&
+                     (ParamSpecified("resume") || ParamSpecified("rescan="));
+        if (!reuse || CheckTestFile() == 0) PurgeTestFile();
         
-        // Check disk space and reduce TestSize accordingly
-        long freeSpace = GetDiskFreeSpace();
-        if (freeSpace < TestSize || ParamSpecified("maxsize")) {
-            TestSize = (freeSpace >> 15) << 15; // Truncate to 32K boundary
+        // A target was sized when it was opened
+        if (!Target) {
+            // Check if specific test size was specified
+            if (ParamSpecified("size=")) {
+                TestSize = StringToValue(GetParam("size="));
+            }
+            
+            // Check disk space and reduce TestSize accordingly
+            long long freeSpace = GetDiskFreeSpace();
+            if (FilePerThread) freeSpace /= Threads;
+            if (freeSpace < TestSize || ParamSpecified("maxsize")) {
+                TestSize = (freeSpace >> 15) << 15; // Truncate to 32K boundary
+            }
         }
         
         printf("\n");
         
-        if (ParamSpecified("mediatest")) {
+        if (ParamSpecified("mediatest") && ParamSpecified("rescan=")) {
+            RescanTest(GetParam("rescan="));
+        } else if (ParamSpecified("mediatest") && ParamSpecified("unique")) {
+            UniqueTest();
+        } else if (ParamSpecified("mediatest")) {
             MediaTest();
         } else if (ParamSpecified("signaltest")) {
             SignalTest();
@@ -136,8 +417,9 @@ int main(int argc, char* argv[]) {
         if (ParamSpecified("lowseeks")) Seeks = 128;
         if (ParamSpecified("minseeks")) Seeks = 32;
         
-        if (Readonly) {
-            printf("Read-only test mode; checking for existing test file...");
+        if (Readonly && !Target) {
+            printf("Read-only test mode; checking for existing test file%s...",
+                   FilePerThread ? "s" : "");
             TestSize = CheckTestFile();
             if (TestSize == 0) {
                 printf(" file not found.\n");
@@ -147,9 +429,74 @@ int main(int argc, char* argv[]) {
             }
         }
         
+        // Every thread's slice must hold at least one transfer
+        long long slice = FilePerThread ? TestSize : TestSize / Threads;
+        if (slice < std::max(SeqBlockSize, RandomBlockSize)) {
+            printf("The test file is too small for %s transfers.\n",
+                   SizeName(std::max(SeqBlockSize, RandomBlockSize)).c_str());
+            return 1;
+        }
+        
+        // Unbuffered I/O must be aligned to every device's logical blocks
+        if (Direct) {
+            std::vector<std::string> paths = TestPaths();
+            for (size_t i = 0; i < paths.size(); i++) {
+                std::string path = Readonly ? ThreadFileName(paths[i].c_str(), 0, FilePerThread)
+                                            : paths[i];
+                if (!CheckDirectIO(path.c_str())) return 1;
+            }
+        }
+        
         // Print test summary
-        printf("Configuration: %ld KB test file, %d IOs in random tests.\n\n", 
-               TestSize / 1024, Seeks);
+        if (RunTime > 0) {
+            printf("Configuration: %lld KB test file, %g s per test", TestSize / 1024, RunTime);
+        } else {
+            printf("Configuration: %lld KB test file, %d IOs in random tests", 
+                   TestSize / 1024, Seeks);
+        }
+        if (RampTime > 0) {
+            printf(", %g s ramp", RampTime);
+        }
+        if (SteadyTolerance > 0) {
+            printf(", stopping at steady state (%g%% over %g s)", SteadyTolerance, SteadyWindow);
+        }
+        if (ParamSpecified("bs=")) {
+            printf(", %s transfers", SizeName(SeqBlockSize).c_str());
+        }
+        if (Rate > 0) {
+            printf(", random tests at %g IOPS", Rate);
+        } else if (RateBytes > 0) {
+            printf(", random tests at %g KB/s", RateBytes / 1024);
+        }
+        if (EngineName[0]) {
+            printf(", %s engine at QD %d", EngineName, QueueDepth);
+        }
+        if (Threads > 1) {
+            printf(", %d threads on %s", Threads, FilePerThread ? "their own files" : "one file");
+        }
+        if (TestFiles.size() > 1) {
+            printf(", %d targets at once", (int)TestFiles.size());
+            if (Threads > 1) printf(" (threads per target)");
+        }
+        if (Direct) {
+            printf(", unbuffered");
+        }
+        if (SyncEvery > 0) {
+            printf(", %s every %d write%s", SyncData ? "fdatasync" : "fsync", SyncEvery,
+                   SyncEvery == 1 ? "" : "s");
+            if (GroupCommit && Threads > 1 && !FilePerThread) printf(" (group commit)");
+        }
+        if (DSync) {
+            printf(", O_DSYNC writes");
+        }
+        if (Distribution.kind != DIST_UNIFORM) {
+            printf(", %s offsets", DistributionName(Distribution).c_str());
+        }
+        printf(", seed %llu", Seed);
+        if (Permute) {
+            printf(" (permuted)");
+        }
+        printf(".\n\n");
         
         double WriteSpeed = 0, ReadSpeed = 0, IOPS = 0;
         
@@ -157,231 +504,963 @@ int main(int argc, char* argv[]) {
             printf("Write Speed         : ");
             WriteSpeed = CreateFile();
             printf("%.2f KB/s\n", WriteSpeed);
+            RecordResult("Sequential write");
+            ShowThreadStats(false);
+            ShowLatency();
         }
         
         printf("Read Speed          : ");
         ReadSpeed = ReadTestFile();
         printf("%.2f KB/s\n", ReadSpeed);
+        RecordResult("Sequential read");
+        ShowThreadStats(false);
+        ShowLatency();
         
-        if (Readonly) {
-            printf("8K random read      : ");
-            IOPS = RandomTest(8192, 100);
+        if (ParamSpecified("qdsweep")) {
+            QueueDepthSweep(Readonly ? 100 : 70);
+        } else if (ParamSpecified("ratesweep")) {
+            RateSweep(Readonly ? 100 : 70);
+        } else if (ParamSpecified("bssweep")) {
+            BlockSizeSweep(Readonly, Readonly ? 100 : 70);
         } else {
-            printf("8K random, 70%% read : ");
-            IOPS = RandomTest(8192, 70);
+            std::string size = SizeName(RandomBlockSize);
+            std::string label = size + (Readonly ? " random read" : " random, 70% read");
+            printf("%-20s: ", label.c_str());
+            IOPS = RandomTest(RandomBlockSize, Readonly ? 100 : 70);
+            printf("%.1f IOPS", IOPS);
+            if (QueueDepth > 1) printf(" (%.2f KB/s)", IOPS * RandomBlockSize / 1024);
+            printf("\n");
+            RecordResult((size + (Readonly ? " random read" : " random 70% read")).c_str());
+            ShowThreadStats(true);
+            ShowLatency();
+            
+            printf("Sector random read  : ");
+            IOPS = RandomTest(SectorSize, 100);
+            printf("%.1f IOPS", IOPS);
+            if (QueueDepth > 1) printf(" (%.2f KB/s)", IOPS * SectorSize / 1024);
+            printf("\n");
+            RecordResult("Sector random read");
+            ShowThreadStats(true);
+            ShowLatency();
+            
+            // Measured per IO, so unlike 1000 / IOPS it holds at any QD
+            double accessTime = MergeStats(ThreadStats).readLatency.Mean() / 1e6;
+            printf("\n");
+            printf("Average access time (includes latency%s), is %.3f ms.\n",
+                   Target ? "" : " and file system overhead", accessTime);
+        }
+        if (ParamSpecified("mmap")) {
+            printf("\n");
+            MappedTests();
         }
-        printf("%.1f IOPS\n", IOPS);
-        
-        printf("Sector random read  : ");
-        IOPS = RandomTest(512, 100);
-        printf("%.1f IOPS\n", IOPS);
-        
-        printf("\n");
-        printf("Average access time (includes latency and file system overhead), is %.0f ms.\n", 
-               1000.0 / IOPS);
         printf("\n");
     }
     
-    if (!Readonly) {
+    if (KeepTestFile) {
+        printf("Keeping %s.\n", FName);
+    } else if (!Readonly) {
         DeleteTestFile();
     }
     
-    return 0;
+    return WriteResults() ? 0 : 1;
+}
+
+// Workload shared by the performance tests, from the command line options
+Workload TestWorkload() {
+    Workload w;
+    w.path = FName;
+    w.mode = IO_READ;
+    w.engine = EngineName;
+    w.queueDepth = QueueDepth;
+    w.blockSize = SeqBlockSize;
+    w.readPercent = 100;
+    w.random = false;
+    w.offset = 0;
+    w.size = TestSize;
+    w.ops = 0;
+    w.threads = Threads;
+    w.filePerThread = FilePerThread;
+    w.direct = Direct;
+    w.preallocate = Prealloc;
+    w.alignment = SectorSize;
+    w.permute = Permute;
+    w.distribution = Distribution;
+    w.seed = Seed;
+    w.progress = !noprogress;
+    w.runtime = RunTime;
+    w.ramp = RampTime;
+    w.steadyTolerance = SteadyTolerance;
+    w.steadyWindow = SteadyWindow;
+    w.rate = 0;
+    w.rateBytes = 0;
+    w.buffers = &Buffers;
+    w.logInterval = IntervalLog ? LogInterval : 0;
+    w.syncEvery = SyncEvery;
+    w.syncData = SyncData;
+    w.dsync = DSync;
+    w.groupCommit = GroupCommit;
+    return w;
+}
+
+// Run a test on the workers, keeping its workload for the report.  With
+// paths=, a test of the default test file runs on every target at once,
+// each target with its own group of threads; ThreadStats then holds every
+// group's threads in turn, and LastRun the combined run.
+bool RunTest(const Workload& w) {
+    LastWorkload = w;
+    GroupRuns.clear();
+    if (TestFiles.empty() || w.path != FName) return RunWorkers(w, ThreadStats, LastRun);
+    
+    std::vector<Workload> groups(TestFiles.size(), w);
+    for (size_t g = 0; g < groups.size(); g++) groups[g].path = TestFiles[g].c_str();
+    bool ok = RunWorkerGroups(groups, ThreadStats, GroupRuns);
+    LastRun = GroupRuns[0];
+    for (size_t g = 1; g < GroupRuns.size(); g++) {
+        if (GroupRuns[g].elapsed > LastRun.elapsed) LastRun.elapsed = GroupRuns[g].elapsed;
+    }
+    LastWorkload.path = PathList.c_str();
+    return ok;
 }
 
-void StartClock() {
-    QueryPerformanceCounter(&startTime);
+// The threads of group g of the last test
+std::vector<WorkerStats> GroupStats(size_t g) {
+    size_t threads = ThreadStats.size() / GroupRuns.size();
+    return std::vector<WorkerStats>(ThreadStats.begin() + g * threads,
+                                    ThreadStats.begin() + (g + 1) * threads);
+}
+
+// Add the last test's results to the report under name, and log its
+// intervals if asked
+void RecordResult(const char* name) {
+    Results.Add(name, LastWorkload, ThreadStats, LastRun);
+    // Each target too, when there were several
+    for (size_t g = 0; g < GroupRuns.size() && GroupRuns.size() > 1; g++) {
+        Workload w = LastWorkload;
+        w.path = TestFiles[g].c_str();
+        std::string target = std::string(name) + " [" + TestFiles[g] + "]";
+        Results.Add(target.c_str(), w, GroupStats(g), GroupRuns[g]);
+    }
+    if (!IntervalLog) return;
+    for (size_t t = 0; t < ThreadStats.size(); t++) {
+        const IntervalRing& ring = ThreadStats[t].intervals;
+        if (ring.Dropped() > 0) {
+            printf("  Interval log kept the last %d intervals of thread %d only\n",
+                   (int)ring.Size(), (int)t);
+        }
+        WriteIntervals(IntervalLog, name, (int)t, ring);
+    }
+    fflush(IntervalLog);
 }
 
-double StopClock() {
-    LARGE_INTEGER endTime;
-    QueryPerformanceCounter(&endTime);
+// Describe the host and the device under test, so reports from before and
+// after a kernel or firmware upgrade can be told apart
+void CollectReportInfo() {
+    char host[256], os[256], model[128], firmware[64], value[64];
+    QueryHostInfo(host, sizeof(host), os, sizeof(os));
+    const char* device = Target ? FName : ".";
+    QueryDeviceInfo(device, model, sizeof(model), firmware, sizeof(firmware));
     
-    double elapsed = (double)(endTime.QuadPart - startTime.QuadPart) / frequency.QuadPart;
-    return elapsed > 0 ? elapsed : 0.01; // Prevent division by zero
+    time_t now = time(NULL);
+    strftime(value, sizeof(value), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    Results.AddInfo("version", VERSION);
+    Results.AddInfo("platform", PLATFORM_NAME);
+    Results.AddInfo("time", value);
+    Results.AddInfo("host", host);
+    Results.AddInfo("os", os);
+    snprintf(value, sizeof(value), "%d", CpuCount());
+    Results.AddInfo("cpus", value);
+    Results.AddInfo("device_model", model);
+    Results.AddInfo("device_firmware", firmware);
+    snprintf(value, sizeof(value), "%ld", QueryBlockSize(device));
+    Results.AddInfo("logical_block_size", value);
+}
+
+// Write the report if output= was given ("-" for stdout)
+bool WriteResults() {
+    if (IntervalLog) {
+        fclose(IntervalLog);
+        IntervalLog = NULL;
+        printf("Intervals written to %s.\n", GetParam("intervallog="));
+    }
+    if (!OutputFormat[0]) return true;
+    bool toStdout = ReportStream != NULL;
+    FILE* f = toStdout ? ReportStream : fopen(OutputFile, "w");
+    if (!f) {
+        printf("Cannot write results to %s\n", OutputFile);
+        return false;
+    }
+    if (_stricmp(OutputFormat, "json") == 0) {
+        Results.WriteJson(f);
+    } else {
+        Results.WriteCsv(f);
+    }
+    if (toStdout) {
+        fflush(f);
+    } else {
+        fclose(f);
+        printf("Results written to %s.\n", OutputFile);
+    }
+    return true;
 }
 
 double CreateFile() {
-    HANDLE hFile = CreateFileA(FName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 
-                              FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
+    Workload w = TestWorkload();
+    w.mode = Target ? IO_WRITE : IO_WRITE | IO_CREATE;
+    w.readPercent = 0;
+    
+    if (!RunTest(w)) {
         fprintf(stderr, "Failed to create test file\n");
         return 0;
     }
+    if (MergeStats(ThreadStats).errors > 0) {
+        fprintf(stderr, "Write error\n");
+    }
     
-    const int BUFFER_SIZE = 32768; // 32KB
-    std::vector<char> buffer(BUFFER_SIZE);
-    int max = TestSize / BUFFER_SIZE;
-    int mark = 1;
+    return (MergeStats(ThreadStats).bytes / 1024.0) / LastRun.elapsed;
+}
+
+double ReadTestFile() {
+    Workload w = TestWorkload();
     
-    COORD coord;
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
-    coord.X = csbi.dwCursorPosition.X;
-    coord.Y = csbi.dwCursorPosition.Y;
+    if (!RunTest(w)) {
+        fprintf(stderr, "Failed to open test file for reading\n");
+        return 0;
+    }
+    if (MergeStats(ThreadStats).errors > 0) {
+        fprintf(stderr, "Read error\n");
+    }
     
-    StartClock();
+    return (MergeStats(ThreadStats).bytes / 1024.0) / LastRun.elapsed;
+}
+
+double RandomTest(int transfersize, int readpercent) {
+    Workload w = TestWorkload();
+    w.mode = IO_READ | IO_WRITE;
+    w.blockSize = transfersize;
+    w.readPercent = readpercent;
+    w.random = true;
+    w.ops = Seeks;
+    w.rate = Rate;
+    w.rateBytes = RateBytes;
     
-    for (int i = 1; i <= max; i++) {
-        DWORD bytesWritten;
-        if (!::WriteFile(hFile, buffer.data(), BUFFER_SIZE, &bytesWritten, NULL)) {
-            fprintf(stderr, "Write error\n");
-            break;
+    if (!RunTest(w)) {
+        fprintf(stderr, "Failed to open test file for random access\n");
+        return 0;
+    }
+    
+    return MergeStats(ThreadStats).ops / LastRun.elapsed;
+}
+
+// When the last test settled, and its per-target and per-thread breakdown
+// in KB/s or IOPS
+void ShowThreadStats(bool iops) {
+    if (LastRun.steadyAfter > 0) {
+        printf("  Steady state after %.1f s\n", LastRun.steadyAfter);
+    }
+    if (GroupRuns.size() > 1) {
+        for (size_t g = 0; g < GroupRuns.size(); g++) {
+            WorkerStats s = MergeStats(GroupStats(g));
+            char label[32];
+            snprintf(label, sizeof(label), "Target %d", (int)g + 1);
+            if (iops) {
+                printf("  %-18s: %.1f IOPS  %s\n", label, s.ops / GroupRuns[g].elapsed,
+                       TestFiles[g].c_str());
+            } else {
+                printf("  %-18s: %.2f KB/s  %s\n", label,
+                       (s.bytes / 1024.0) / GroupRuns[g].elapsed, TestFiles[g].c_str());
+            }
         }
-        
-        if (!noprogress) {
-            mark++;
-            if (mark > DISPLAY_CODES_COUNT) mark = 1;
-            printf("%c", DISPLAY_CODES[mark - 1]);
-            SetConsoleCursorPosition(hConsole, coord);
+        if (ThreadStats.size() == GroupRuns.size()) return;
+    }
+    if (ThreadStats.size() < 2) return;
+    
+    for (size_t t = 0; t < ThreadStats.size(); t++) {
+        const WorkerStats& s = ThreadStats[t];
+        double elapsed = s.elapsed > 0 ? s.elapsed : 0.01;
+        char label[32];
+        if (s.cpu >= 0) {
+            snprintf(label, sizeof(label), "Thread %d (CPU %d)", (int)t, s.cpu);
+        } else {
+            snprintf(label, sizeof(label), "Thread %d", (int)t);
+        }
+        if (iops) {
+            printf("  %-18s: %.1f IOPS\n", label, s.ops / elapsed);
+        } else {
+            printf("  %-18s: %.2f KB/s\n", label, (s.bytes / 1024.0) / elapsed);
         }
     }
+}
+
+static void ShowHistogram(const char* label, const Histogram& h) {
+    if (h.Count() == 0) return;
+    printf("  %-18s: min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f us\n",
+           label, h.Min() / 1e3, h.Percentile(50) / 1e3, h.Percentile(90) / 1e3,
+           h.Percentile(99) / 1e3, h.Percentile(99.9) / 1e3, h.Max() / 1e3);
+}
+
+// Latency percentiles of the last test, for reads and writes separately,
+// and when writes were flushed how long they took to become durable
+void ShowLatency() {
+    WorkerStats total = MergeStats(ThreadStats);
+    ShowHistogram("Read latency", total.readLatency);
+    ShowHistogram("Write latency", total.writeLatency);
+    ShowHistogram("Commit latency", total.commitLatency);
+    if (total.flushes > 0) {
+        printf("  %-18s: %lld (%.1f per second, %.1f writes each)\n", "Flushes", total.flushes,
+               total.flushes / LastRun.elapsed,
+               (double)total.writeLatency.Count() / total.flushes);
+    }
+    // Mapped access does its IO through page faults
+    if (LastWorkload.engine && _stricmp(LastWorkload.engine, "mmap") == 0) {
+        printf("  Page faults       : %lld minor, %lld major (%.2f per IO)\n",
+               LastRun.minorFaults, LastRun.majorFaults,
+               total.ops > 0 ? (LastRun.minorFaults + LastRun.majorFaults) / (double)total.ops : 0);
+    }
+}
+
+// Repeat the read tests through a memory mapping of the same file, for
+// comparison with the read() results above
+void MappedTests() {
+    char saved[sizeof(EngineName)];
+    memcpy(saved, EngineName, sizeof(saved));
+    snprintf(EngineName, sizeof(EngineName), "mmap");
     
-    CloseHandle(hFile);
-    return (TestSize / 1024.0) / StopClock();
+    printf("Mapped read speed   : ");
+    double speed = ReadTestFile();
+    printf("%.2f KB/s\n", speed);
+    RecordResult("Mapped sequential read");
+    ShowThreadStats(false);
+    ShowLatency();
+    
+    // One page per IO, the unit a mapping is read in
+    printf("Mapped random read  : ");
+    double iops = RandomTest((int)PageSize(), 100);
+    printf("%.1f IOPS\n", iops);
+    RecordResult("Mapped random read");
+    ShowThreadStats(true);
+    ShowLatency();
+    
+    memcpy(EngineName, saved, sizeof(saved));
 }
 
-double ReadTestFile() {
-    HANDLE hFile = CreateFileA(FName, GENERIC_READ, FILE_SHARE_READ, NULL, 
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Failed to open test file for reading\n");
-        return 0;
+// Look up the logical block size that unbuffered I/O to path must be
+// aligned to, and check every test's transfers fit it before starting.
+// The sector test then uses one logical block per IO.
+bool CheckDirectIO(const char* path) {
+    long blockSize = QueryBlockSize(path);
+    printf("Unbuffered I/O: %ld byte logical blocks.\n", blockSize);
+    
+    const int transfers[] = {SeqBlockSize, RandomBlockSize};
+    for (int i = 0; i < 2; i++) {
+        if (transfers[i] % blockSize != 0) {
+            printf("%d byte transfers are not a multiple of the logical block size;\n", transfers[i]);
+            printf("unbuffered testing is not possible on this device.\n");
+            return false;
+        }
+    }
+    if (blockSize > SectorSize) SectorSize = (int)blockSize;
+    return true;
+}
+
+// Run both random tests at doubling queue depths up to QueueDepth (or the
+// engine's maximum if qd= was not given) and tabulate how they scale.
+void QueueDepthSweep(int readpercent) {
+    int maxDepth = ParamSpecified("qd=") ? QueueDepth : MAX_QUEUE_DEPTH;
+    std::unique_ptr<IOEngine> probe(CreateEngine(EngineName, maxDepth));
+    if (probe->QueueDepth() < maxDepth) maxDepth = probe->QueueDepth();
+    
+    std::string size = SizeName(RandomBlockSize);
+    printf("Queue depth scaling, %s engine:\n\n", probe->Name());
+    printf("   QD %4s %3d%% read IOPS       KB/s   Sector read IOPS       KB/s\n", size.c_str(),
+           readpercent);
+    
+    int savedDepth = QueueDepth;
+    for (int depth = 1; depth <= maxDepth && !QUIT; depth *= 2) {
+        QueueDepth = depth;
+        printf("  %3d   ", depth);
+        char name[48];
+        double IOPSRandom = RandomTest(RandomBlockSize, readpercent);
+        printf("%17.1f %10.2f   ", IOPSRandom, IOPSRandom * RandomBlockSize / 1024);
+        snprintf(name, sizeof(name), "QD %d %s random %d%% read", depth, size.c_str(), readpercent);
+        RecordResult(name);
+        double IOPSSector = RandomTest(SectorSize, 100);
+        printf("%16.1f %10.2f\n", IOPSSector, IOPSSector * SectorSize / 1024);
+        snprintf(name, sizeof(name), "QD %d sector random read", depth);
+        RecordResult(name);
+    }
+    QueueDepth = savedDepth;
+}
+
+// Run the main random test at a tenth of the rate=, or of the rate it
+// reaches flat out, then at two tenths and so on up to the full rate, and
+// tabulate the latency at each load.  The latency is measured from when
+// each IO was due, so as the disk saturates the queueing shows up in it.
+void RateSweep(int readpercent) {
+    double savedRate = Rate, savedBytes = RateBytes;
+    double top = Rate > 0 ? Rate : RateBytes / RandomBlockSize;
+    std::string size = SizeName(RandomBlockSize);
+    char name[64];
+    
+    printf("Latency under load, %s random %d%% read", size.c_str(), readpercent);
+    if (top <= 0) {
+        Rate = RateBytes = 0;
+        top = RandomTest(RandomBlockSize, readpercent);
+        snprintf(name, sizeof(name), "Flat out %s random %d%% read", size.c_str(), readpercent);
+        RecordResult(name);
+        printf(", %.1f IOPS flat out", top);
+    }
+    printf(":\n\n");
+    printf("  Load   Target IOPS  Achieved IOPS     p50 us     p99 us   p99.9 us\n");
+    
+    const int STEPS = 10;
+    for (int step = 1; step <= STEPS && top > 0 && !QUIT; step++) {
+        Rate = top * step / STEPS;
+        RateBytes = 0;
+        double iops = RandomTest(RandomBlockSize, readpercent);
+        snprintf(name, sizeof(name), "%.0f IOPS %s random %d%% read", Rate, size.c_str(),
+                 readpercent);
+        RecordResult(name);
+        WorkerStats total = MergeStats(ThreadStats);
+        Histogram latency = total.readLatency;
+        latency.Merge(total.writeLatency);
+        printf("  %3d%%  %12.1f  %13.1f %10.1f %10.1f %10.1f\n", step * 100 / STEPS, Rate, iops,
+               latency.Percentile(50) / 1e3, latency.Percentile(99) / 1e3,
+               latency.Percentile(99.9) / 1e3);
+    }
+    Rate = savedRate;
+    RateBytes = savedBytes;
+}
+
+// Run the sequential tests and the main random test at each power of two
+// transfer size from 4K to 4M, as far as the test file allows, and tabulate
+// how throughput and latency change with size.  The buffers for the largest
+// size are allocated once before starting and reused at every size.
+void BlockSizeSweep(bool readonly, int readpercent) {
+    const int SMALLEST = 4096;
+    long long slice = FilePerThread ? TestSize : TestSize / Threads;
+    int largest = MAX_TRANSFER;
+    while (largest > SMALLEST && largest > slice) largest /= 2;
+    int threads = Threads * (TestFiles.empty() ? 1 : (int)TestFiles.size());
+    if (!ReserveBuffers(Buffers, threads, QueueDepth, largest, SectorSize)) {
+        printf("Not enough memory for %s transfers at QD %d.\n", SizeName(largest).c_str(),
+               QueueDepth);
+        return;
     }
     
-    const int BUFFER_SIZE = 32768; // 32KB
-    std::vector<char> buffer(BUFFER_SIZE);
-    int max = TestSize / BUFFER_SIZE;
-    int mark = 1;
+    printf("Transfer size scaling, random tests %d%% read:\n\n", readpercent);
+    printf("    Size   Write KB/s    Read KB/s  Random IOPS  Random KB/s     p50 us     p99 us\n");
     
-    COORD coord;
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
-    coord.X = csbi.dwCursorPosition.X;
-    coord.Y = csbi.dwCursorPosition.Y;
+    int savedSeq = SeqBlockSize, savedRandom = RandomBlockSize;
+    for (int size = SMALLEST; size <= largest && !QUIT; size *= 2) {
+        if (size % SectorSize != 0) continue; // Unbuffered on a larger logical block
+        SeqBlockSize = RandomBlockSize = size;
+        std::string sizeName = SizeName(size);
+        std::string name;
+        printf("  %6s ", sizeName.c_str());
+        if (readonly) {
+            printf(" %12s", "-");
+        } else {
+            printf(" %12.2f", CreateFile());
+            name = sizeName + " sequential write";
+            RecordResult(name.c_str());
+        }
+        printf(" %12.2f", ReadTestFile());
+        name = sizeName + " sequential read";
+        RecordResult(name.c_str());
+        
+        double iops = RandomTest(size, readpercent);
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), " random %d%% read", readpercent);
+        name = sizeName + suffix;
+        RecordResult(name.c_str());
+        WorkerStats total = MergeStats(ThreadStats);
+        Histogram latency = total.readLatency;
+        latency.Merge(total.writeLatency);
+        printf(" %12.1f %12.2f %10.1f %10.1f\n", iops, iops * size / 1024,
+               latency.Percentile(50) / 1e3, latency.Percentile(99) / 1e3);
+    }
+    SeqBlockSize = savedSeq;
+    RandomBlockSize = savedRandom;
+}
+
+// Run each job in a job file in turn on the shared workers, with results
+// shown as for the built-in tests.  Command line options supply the
+// defaults; jobs without a file= use the default test file, which is
+// deleted afterwards unless readonly was given.  readonly runs only read=100
+// jobs, on files that already hold their region.  A target= is never
+// prepared, and the first job that writes to it asks for confirmation.
+bool RunJobFile(const char* path, bool readonly) {
+    Job defaults;
+    defaults.blockSize = 8192;
+    defaults.readPercent = 100;
+    defaults.random = true;
+    defaults.queueDepth = QueueDepth;
+    defaults.threads = Threads;
+    defaults.offset = 0;
+    defaults.size = ParamSpecified("size=") ? StringToValue(GetParam("size=")) : TestSize;
+    defaults.ops = Seeks;
+    if (ParamSpecified("maxseeks")) defaults.ops = 4096;
+    if (ParamSpecified("highseeks")) defaults.ops = 1024;
+    if (ParamSpecified("lowseeks")) defaults.ops = 128;
+    if (ParamSpecified("minseeks")) defaults.ops = 32;
+    defaults.runtime = RunTime;
+    defaults.ramp = RampTime;
+    defaults.direct = Direct;
+    defaults.permute = Permute;
+    defaults.distribution = Distribution;
+    defaults.seed = Seed;
+    defaults.rate = Rate;
+    defaults.rateBytes = RateBytes;
+    defaults.syncEvery = SyncEvery;
+    defaults.syncData = SyncData;
+    defaults.dsync = DSync;
+    defaults.groupCommit = GroupCommit;
     
-    StartClock();
+    std::vector<Job> jobs;
+    if (!LoadJobFile(path, defaults, jobs)) return false;
+    for (size_t i = 0; i < jobs.size() && readonly; i++) {
+        if (jobs[i].readPercent < 100) {
+            printf("[%s] writes (read=%d), and cannot be run with readonly.\n",
+                   jobs[i].name.c_str(), jobs[i].readPercent);
+            return false;
+        }
+    }
+    printf("Running %d job%s from %s.\n\n", (int)jobs.size(), jobs.size() == 1 ? "" : "s", path);
     
-    for (int i = 1; i <= max; i++) {
-        DWORD bytesRead;
-        if (!::ReadFile(hFile, buffer.data(), BUFFER_SIZE, &bytesRead, NULL)) {
-            fprintf(stderr, "Read error\n");
+    bool usedDefault = false;
+    bool confirmed = false;
+    bool ok = true;
+    for (size_t i = 0; i < jobs.size() && ok && !QUIT; i++) {
+        const Job& job = jobs[i];
+        const char* file = job.file.empty() ? FName : job.file.c_str();
+        if (job.file.empty()) usedDefault = true;
+        
+        Workload w = TestWorkload();
+        w.path = file;
+        w.mode = job.readPercent < 100 ? IO_READ | IO_WRITE : IO_READ;
+        if (!job.engine.empty()) w.engine = job.engine.c_str();
+        w.queueDepth = job.queueDepth;
+        w.blockSize = job.blockSize;
+        w.readPercent = job.readPercent;
+        w.random = job.random;
+        w.offset = job.offset;
+        w.size = job.size;
+        w.ops = job.ops;
+        w.threads = job.threads;
+        w.filePerThread = false;
+        w.direct = job.direct;
+        w.runtime = job.runtime;
+        w.ramp = job.ramp;
+        w.permute = job.permute;
+        w.distribution = job.distribution;
+        w.seed = job.seed;
+        w.rate = job.rate;
+        w.rateBytes = job.rateBytes;
+        w.syncEvery = job.syncEvery;
+        w.syncData = job.syncData;
+        w.dsync = job.dsync;
+        w.groupCommit = job.groupCommit;
+        
+        printf("[%s] %s %s %s, %d%% read, QD %d, %d thread%s, %lld KB at %lld KB\n",
+               job.name.c_str(), file, SizeName(job.blockSize).c_str(),
+               job.random ? "random" : "sequential",
+               job.readPercent, job.queueDepth, job.threads, job.threads == 1 ? "" : "s",
+               job.size / 1024, job.offset / 1024);
+        
+        long long length = job.offset + job.size;
+        if (Target && strcmp(file, FName) == 0) {
+            if (length > TestSize) {
+                printf("[%s] runs past the end of the target.\n", job.name.c_str());
+                ok = false;
+                break;
+            }
+            if (job.readPercent < 100 && !confirmed) {
+                if (!ConfirmOverwrite()) {
+                    ok = false;
+                    break;
+                }
+                confirmed = true;
+            }
+        } else if (readonly ? !CheckJobFile(file, length) : !PrepareJobFile(file, length)) {
+            ok = false;
             break;
         }
+        if (job.direct) {
+            w.alignment = (int)QueryBlockSize(file);
+            if (job.blockSize % w.alignment != 0 || job.offset % w.alignment != 0) {
+                printf("bs and offset must be multiples of the %d byte logical block size\n",
+                       w.alignment);
+                ok = false;
+                break;
+            }
+        }
         
-        if (!noprogress) {
-            mark++;
-            if (mark > DISPLAY_CODES_COUNT) mark = 1;
-            printf("%c", DISPLAY_CODES[mark - 1]);
-            SetConsoleCursorPosition(hConsole, coord);
+        if (!RunTest(w)) {
+            fprintf(stderr, "Failed to open %s\n", file);
+            ok = false;
+            break;
         }
+        RecordResult(job.name.c_str());
+        WorkerStats total = MergeStats(ThreadStats);
+        printf("  %-18s: %.2f KB/s, %.1f IOPS\n", "Result",
+               (total.bytes / 1024.0) / LastRun.elapsed, total.ops / LastRun.elapsed);
+        if (total.errors > 0) printf("  %-18s: %lld\n", "Errors", total.errors);
+        ShowThreadStats(job.random);
+        ShowLatency();
+        printf("\n");
     }
     
-    CloseHandle(hFile);
-    return (TestSize / 1024.0) / StopClock();
+    if (usedDefault && !readonly) DeleteTestFile();
+    return ok;
 }
 
-double RandomTest(int transfersize, int readpercent) {
-    HANDLE hFile = CreateFileA(FName, GENERIC_READ | GENERIC_WRITE, 0, NULL, 
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Failed to open test file for random access\n");
-        return 0;
+// Make sure path exists and holds at least length bytes, writing data
+// rather than leaving a sparse file so reads come from the disk
+bool PrepareJobFile(const char* path, long long length) {
+    std::unique_ptr<IOEngine> file(CreateEngine(NULL));
+    if (!file->Open(path, IO_READ | IO_WRITE) && !file->Open(path, IO_WRITE | IO_CREATE)) {
+        printf("Cannot create %s\n", path);
+        return false;
+    }
+    long long size = file->Size();
+    if (size >= length) return true;
+    
+    printf("  Preparing %s...", path);
+    fflush(stdout);
+    file->Preallocate(length); // Fewer fragments; harmless if unsupported
+    std::vector<char> block(32768);
+    for (size_t i = 0; i < block.size(); i++) block[i] = (char)rand();
+    for (long long offset = size; offset < length; offset += (long long)block.size()) {
+        long chunk = (long)std::min<long long>((long long)block.size(), length - offset);
+        if (file->Write(block.data(), chunk, offset) != chunk) {
+            printf(" write error.\n");
+            return false;
+        }
+    }
+    printf(" done.\n");
+    return true;
+}
+
+// For readonly: path must already hold at least length bytes
+bool CheckJobFile(const char* path, long long length) {
+    std::unique_ptr<IOEngine> file(CreateEngine(NULL));
+    if (!file->Open(path, IO_READ)) {
+        printf("Cannot open %s; readonly jobs need an existing file.\n", path);
+        return false;
+    }
+    if (file->Size() < length) {
+        printf("%s is smaller than the %lld KB the job reads.\n", path, length / 1024);
+        return false;
+    }
+    return true;
+}
+
+// Build a directory tree of small files under metadir= and time creating,
+// statting, reading, renaming and deleting every one of them
+bool MetadataTest() {
+    MetaWorkload meta;
+    std::string dir = ParamSpecified("metadir=") ? GetParam("metadir=") : ".";
+    meta.root = dir + PATH_SEPARATOR + "disktest.meta";
+    meta.files = ParamSpecified("files=") ? atoi(GetParam("files=")) : 10000;
+    meta.fileSize = ParamSpecified("filesize=") ? (int)StringToValue(GetParam("filesize=")) : 4096;
+    meta.fanout = ParamSpecified("fanout=") ? atoi(GetParam("fanout=")) : 16;
+    meta.depth = ParamSpecified("depth=") ? atoi(GetParam("depth=")) : 2;
+    meta.threads = Threads;
+    if (meta.files < 1 || meta.fileSize < 0 || meta.fileSize > MAX_TRANSFER) {
+        printf("files= must be at least 1 and filesize= at most %dM.\n", MAX_TRANSFER >> 20);
+        return false;
+    }
+    long long leaves = 1;
+    for (int level = 0; level < meta.depth && leaves <= MAX_META_LEAVES; level++) {
+        leaves *= meta.fanout;
+    }
+    if (meta.fanout < 1 || meta.fanout > 256 || meta.depth < 0 || leaves > MAX_META_LEAVES) {
+        printf("fanout= must be 1 to 256, with at most %d directories at depth=.\n",
+               MAX_META_LEAVES);
+        return false;
     }
     
-    std::vector<char> buffer(32768); // Max transfer size
-    std::vector<long> positions(Seeks);
+    printf("Metadata test: %d files of %s in %s, %lld director%s of %d levels, %d thread%s\n\n",
+           meta.files, SizeName(meta.fileSize).c_str(), meta.root.c_str(), leaves,
+           leaves == 1 ? "y" : "ies", meta.depth, meta.threads, meta.threads == 1 ? "" : "s");
+    if (!BuildMetadataTree(meta)) return false;
     
-    // Initialize random number generator
-    srand(GetTickCount());
+    Workload w = TestWorkload();
+    w.path = meta.root.c_str();
+    w.mode = IO_READ | IO_WRITE;
+    w.engine = "";
+    w.queueDepth = 1;
+    w.blockSize = meta.fileSize;
+    w.random = false;
+    w.size = (long long)meta.files * meta.fileSize;
+    w.ops = meta.files;
+    w.filePerThread = true;
+    w.direct = false;
+    w.runtime = w.ramp = 0;
+    w.steadyTolerance = 0;
+    w.logInterval = 0;
+    w.syncEvery = 0;
+    w.dsync = false;
     
-    // Generate random positions
-    long max = TestSize - transfersize;
-    for (int i = 0; i < Seeks; i++) {
-        long pos = (long)(((double)rand() / RAND_MAX) * max);
-        pos = pos & 0xFFFFFE00; // Sector align
-        positions[i] = pos;
+    printf("%-10s %10s %10s %10s %10s %10s %8s\n", "Operation", "ops/s", "mean us",
+           "p50 us", "p99 us", "p99.9 us", "errors");
+    bool ok = true;
+    for (int op = 0; op < META_OPS && !QUIT; op++) {
+        MetaPhase phase;
+        RunMetadataPhase(meta, (MetaOp)op, phase);
+        WorkerStats total = MergeStats(phase.stats);
+        Histogram latency = total.readLatency;
+        latency.Merge(total.writeLatency);
+        printf("%-10s %10.0f %10.1f %10.1f %10.1f %10.1f %8lld\n", META_OP_NAMES[op],
+               total.ops / phase.elapsed, latency.Mean() / 1e3, latency.Percentile(50) / 1e3,
+               latency.Percentile(99) / 1e3, latency.Percentile(99.9) / 1e3, total.errors);
+        if (total.errors > 0) ok = false;
+        
+        w.readPercent = op == META_STAT || op == META_READ ? 100 : 0;
+        RunResult run = {phase.elapsed, 0, 0, 0};
+        std::string name = std::string("Metadata ") + META_OP_NAMES[op];
+        Results.Add(name.c_str(), w, phase.stats, run);
     }
+    printf("\n");
     
-    int n = 1;
-    int mark = 1;
-    int limit = readpercent / 10;
+    // A failed or interrupted phase can leave files behind
+    RemoveMetadataTree(meta, !ok || QUIT);
+    return ok;
+}
+
+// Replay the trace in replay= (imported first from import=, if given)
+// against the test file or target=, and show each kind of IO's latency.
+// The test file is made big enough for the trace's offsets unless size=
+// or the free space says otherwise; offsets beyond it wrap round.
+bool ReplayTest(bool readonly) {
+    // A copy, as the next GetParam reuses its buffer
+    std::string trace = GetParam("replay=");
+    const char* path = trace.c_str();
+    if (!TestFiles.empty()) {
+        printf("replay= runs on one file, and cannot be used with paths=.\n");
+        return false;
+    }
+    double speed = ParamSpecified("speed=") ? atof(GetParam("speed=")) : 1;
+    if (speed < 0) {
+        printf("speed= must be 1 for the original timing, 2 for twice as fast..., or 0 for\n");
+        printf("as fast as possible.\n");
+        return false;
+    }
+    if (ParamSpecified("import=") && !ImportTrace(GetParam("import="), path)) return false;
+    TraceReader reader;
+    if (!reader.Open(path)) return false;
+    const TraceHeader& header = reader.Header();
     
-    COORD coord;
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
-    coord.X = csbi.dwCursorPosition.X;
-    coord.Y = csbi.dwCursorPosition.Y;
+    long long existing = Target ? TestSize : CheckTestFile();
+    if (readonly && existing == 0) {
+        printf("Read-only replay needs an existing test file.\n");
+        return false;
+    }
+    if (readonly || Target) {
+        TestSize = existing;
+    } else {
+        TestSize = ParamSpecified("size=") ? StringToValue(GetParam("size="))
+                                           : (long long)header.extent;
+        long long room = existing + GetDiskFreeSpace() / 10 * 9;
+        if (TestSize > room) TestSize = room;
+        if (TestSize < MAX_TRANSFER) TestSize = MAX_TRANSFER;
+        TestSize = (TestSize >> 15) << 15; // Truncate to 32K boundary
+        if (!PrepareJobFile(FName, TestSize)) return false;
+    }
+    if (Direct) {
+        long blockSize = QueryBlockSize(FName);
+        if (blockSize > SectorSize) SectorSize = (int)blockSize;
+    }
+    
+    Workload w = TestWorkload();
+    w.mode = readonly ? IO_READ : IO_READ | IO_WRITE;
+    w.random = true;
+    w.distribution.kind = DIST_UNIFORM;
+    w.blockSize = (int)header.maxLength;
+    w.ops = (long long)header.records;
+    w.threads = 1;
+    w.filePerThread = false;
+    w.runtime = w.ramp = 0;
+    w.steadyTolerance = 0;
+    w.logInterval = 0;
+    w.syncEvery = 0;
+    w.dsync = false;
+    
+    printf("Replaying %lld IOs over %.1f s from %s ", (long long)header.records,
+           header.duration / 1e9, path);
+    if (speed > 0) {
+        printf("at %gx the original timing", speed);
+    } else {
+        printf("as fast as possible");
+    }
+    printf(", QD %d%s, on %s (%lld KB).\n\n", QueueDepth, Direct ? ", unbuffered" : "", FName,
+           TestSize / 1024);
     
-    StartClock();
+    long long skipped = 0;
+    ThreadStats.assign(1, WorkerStats());
+    GroupRuns.clear();
+    bool ok = ReplayTrace(reader, w, speed, readonly, ThreadStats[0], LastRun, skipped);
+    if (ok) {
+        const WorkerStats& s = ThreadStats[0];
+        long long transfers = s.readLatency.Count() + s.writeLatency.Count();
+        if (transfers > 0) w.readPercent = (int)(s.readLatency.Count() * 100 / transfers);
+        LastWorkload = w;
+        RecordResult("Replay");
+        printf("%-20s: %.1f IOPS, %.2f KB/s in %.1f s\n", "Replay", s.ops / LastRun.elapsed,
+               (s.bytes / 1024.0) / LastRun.elapsed, LastRun.elapsed);
+        if (s.errors > 0) printf("  %-18s: %lld\n", "Errors", s.errors);
+        if (skipped > 0) printf("  %-18s: %lld writes and flushes (readonly)\n", "Skipped", skipped);
+        ShowLatency();
+        printf("\n");
+    } else {
+        fprintf(stderr, "Failed to open %s\n", FName);
+    }
     
-    for (int i = 0; i < Seeks; i++) {
-        if (!noprogress) {
-            mark++;
-            if (mark > DISPLAY_CODES_COUNT) mark = 1;
-            printf("%c", DISPLAY_CODES[mark - 1]);
-            SetConsoleCursorPosition(hConsole, coord);
+    if (!readonly && !Target) DeleteTestFile();
+    return ok && ThreadStats[0].errors == 0;
+}
+
+// target= tests an existing device, or a file standing in for one, in
+// place: it is never created, truncated or deleted.  Size the test to it,
+// and have the user confirm before any test overwrites it.
+bool OpenTarget(bool writes) {
+    DeviceGeometry geometry;
+    long long size;
+    if (QueryDeviceGeometry(FName, geometry)) {
+        size = geometry.size;
+        printf("Target %s: %.1f GB device, %ld byte logical and %ld byte physical blocks.\n",
+               FName, size / 1e9, geometry.logicalBlock, geometry.physicalBlock);
+    } else {
+        size = CheckTestFile();
+        if (size == 0) {
+            printf("Target %s does not exist or is empty.\n", FName);
+            return false;
         }
-        
-        // Seek to position
-        SetFilePointer(hFile, positions[i], NULL, FILE_BEGIN);
-        
-        DWORD bytesTransferred;
-        if (n <= limit) {
-            // Read operation
-            ::ReadFile(hFile, buffer.data(), transfersize, &bytesTransferred, NULL);
-        } else {
-            // Write operation
-            ::WriteFile(hFile, buffer.data(), transfersize, &bytesTransferred, NULL);
+        printf("Target %s: %lld KB file.\n", FName, size / 1024);
+    }
+    if (ParamSpecified("size=")) {
+        long long wanted = StringToValue(GetParam("size="));
+        if (wanted > size) {
+            printf("size= is larger than the target.\n");
+            return false;
         }
-        
-        n++;
-        if (n > 10) n = 1;
+        size = wanted;
     }
-    
-    CloseHandle(hFile);
-    return Seeks / StopClock();
+    TestSize = (size >> 15) << 15; // Whole 32K blocks
+    if (TestSize == 0) {
+        printf("The target is too small to test.\n");
+        return false;
+    }
+    return !writes || ConfirmOverwrite();
+}
+
+// Unless overwrite was given, ask for YES on standard input, so a script
+// that has not thought about it cannot wipe a disk
+bool ConfirmOverwrite() {
+    if (ParamSpecified("overwrite")) return true;
+    printf("\nThe write tests will DESTROY ALL DATA on %s.\n", FName);
+    printf("Type YES to continue (or use readonly, or overwrite to skip this): ");
+    fflush(stdout);
+    char answer[16];
+    if (!fgets(answer, sizeof(answer), stdin) || strncmp(answer, "YES", 3) != 0) {
+        printf("\nNot confirmed; nothing written.\n");
+        return false;
+    }
+    printf("\n");
+    return true;
+}
+
+// paths= lists directories (which get a test file of the usual name) and
+// files, each on its own target; FName becomes the first
+bool SetTestPaths(const char* list) {
+    std::string paths = list;
+    size_t start = 0;
+    while (start <= paths.size()) {
+        size_t comma = paths.find(',', start);
+        if (comma == std::string::npos) comma = paths.size();
+        std::string path = paths.substr(start, comma - start);
+        start = comma + 1;
+        if (path.empty()) continue;
+        if (IsDirectory(path.c_str())) {
+            char last = path[path.size() - 1];
+            if (last != '/' && last != '\\') path += PATH_SEPARATOR;
+            path += DEFAULT_FILENAME;
+        }
+        TestFiles.push_back(path);
+        PathList += (PathList.empty() ? "" : ",") + path;
+    }
+    if (TestFiles.empty() || TestFiles[0].size() >= sizeof(FName)) {
+        printf("paths= must list directories or files, separated by commas.\n");
+        return false;
+    }
+    snprintf(FName, sizeof(FName), "%s", TestFiles[0].c_str());
+    return true;
+}
+
+// Every test file: one per target with paths=, otherwise just FName
+std::vector<std::string> TestPaths() {
+    if (!TestFiles.empty()) return TestFiles;
+    return std::vector<std::string>(1, FName);
 }
 
 void PurgeTestFile() {
-    HANDLE hFile = CreateFileA(FName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 
-                              FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile != INVALID_HANDLE_VALUE) {
-        CloseHandle(hFile);
+    if (Target) return;
+    std::vector<std::string> paths = TestPaths();
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::unique_ptr<IOEngine> file(CreateEngine(NULL));
+        if (file->Open(paths[i].c_str(), IO_WRITE | IO_CREATE)) {
+            file->Close();
+        }
     }
 }
 
 void DeleteTestFile() {
-    printf("Deleting %s.\n", FName);
-    DeleteFileA(FName);
+    if (Target) return;
+    std::vector<std::string> paths = TestPaths();
+    for (size_t i = 0; i < paths.size(); i++) {
+        printf("Deleting %s.\n", paths[i].c_str());
+        remove(paths[i].c_str());
+        if (FilePerThread) {
+            for (int t = 0; t < Threads; t++) {
+                remove(ThreadFileName(paths[i].c_str(), t, true).c_str());
+            }
+        }
+    }
 }
 
-long CheckTestFile() {
-    HANDLE hFile = CreateFileA(FName, GENERIC_READ, FILE_SHARE_READ, NULL, 
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        return 0;
+// Size of the test file, or of the smallest with paths=; 0 if any is missing
+long long CheckTestFile() {
+    std::vector<std::string> paths = TestPaths();
+    long long smallest = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::unique_ptr<IOEngine> file(CreateEngine(NULL));
+        if (!file->Open(ThreadFileName(paths[i].c_str(), 0, FilePerThread).c_str(), IO_READ)) {
+            return 0;
+        }
+        long long fileSize = file->Size();
+        file->Close();
+        if (fileSize <= 0) return 0;
+        if (i == 0 || fileSize < smallest) smallest = fileSize;
     }
-    
-    DWORD fileSize = GetFileSize(hFile, NULL);
-    CloseHandle(hFile);
-    return fileSize;
+    return smallest;
 }
 
-long GetDiskFreeSpace() {
-    ULARGE_INTEGER freeBytesAvailable;
-    if (GetDiskFreeSpaceExA(".", &freeBytesAvailable, NULL, NULL)) {
-        return (long)freeBytesAvailable.QuadPart;
+// Free space for the test file, or the least on any target with paths=
+long long GetDiskFreeSpace() {
+    if (TestFiles.empty()) return QueryFreeSpace(".");
+    long long least = 0;
+    for (size_t i = 0; i < TestFiles.size(); i++) {
+        size_t slash = TestFiles[i].find_last_of("/\\");
+        std::string directory = slash == std::string::npos ? "." : TestFiles[i].substr(0, slash + 1);
+        long long space = QueryFreeSpace(directory.c_str());
+        if (i == 0 || space < least) least = space;
     }
-    return 0;
+    return least;
 }
 
 bool ParamSpecified(const char* param) {
-    for (int i = 1; i < __argc; i++) {
-        if (_strnicmp(__argv[i], param, strlen(param)) == 0) {
+    for (int i = 1; i < ParamCount; i++) {
+        if (_strnicmp(ParamValues[i], param, strlen(param)) == 0) {
             return true;
         }
     }
@@ -392,25 +1471,29 @@ const char* GetParam(const char* param) {
     static char result[256];
     result[0] = '\0';
     
-    for (int i = 1; i < __argc; i++) {
-        if (_strnicmp(__argv[i], param, strlen(param)) == 0) {
-            strcpy_s(result, sizeof(result), __argv[i] + strlen(param));
+    for (int i = 1; i < ParamCount; i++) {
+        if (_strnicmp(ParamValues[i], param, strlen(param)) == 0) {
+            snprintf(result, sizeof(result), "%s", ParamValues[i] + strlen(param));
             break;
         }
     }
     return result;
 }
 
-long StringToValue(const char* s) {
+long long StringToValue(const char* s) {
     if (!s || !*s) return DEFAULT_TEST_SIZE;
     
     char* endptr;
-    long value = strtol(s, &endptr, 10);
+    long long value = strtoll(s, &endptr, 10);
     
     if (*endptr == 'K' || *endptr == 'k') {
         value *= 1024;
     } else if (*endptr == 'M' || *endptr == 'm') {
         value *= 1024 * 1024;
+    } else if (*endptr == 'G' || *endptr == 'g') {
+        value <<= 30;
+    } else if (*endptr == 'T' || *endptr == 't') {
+        value <<= 40;
     }
     
     if (value < 65536) {
@@ -421,6 +1504,35 @@ long StringToValue(const char* s) {
     return value;
 }
 
+// Transfer size in bytes with an optional K or M suffix; 0 unless it is a
+// multiple of 512 up to MAX_TRANSFER
+int ParseBlockSize(const char* s) {
+    char* end;
+    long long value = strtoll(s, &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        value <<= 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        value <<= 20;
+        end++;
+    }
+    if (*end != '\0' || value < 512 || value > MAX_TRANSFER || value % 512 != 0) return 0;
+    return (int)value;
+}
+
+// "512", "8K" or "4M"
+std::string SizeName(long bytes) {
+    char name[32];
+    if (bytes >= 1048576 && bytes % 1048576 == 0) {
+        snprintf(name, sizeof(name), "%ldM", bytes >> 20);
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        snprintf(name, sizeof(name), "%ldK", bytes >> 10);
+    } else {
+        snprintf(name, sizeof(name), "%ld", bytes);
+    }
+    return name;
+}
+
 void ShowHelp() {
     printf("Disk and interface performance and reliability testing.\n\n");
     printf("With no command line parameters, the utility will perform a file-system based\n");
@@ -433,76 +1545,161 @@ void ShowHelp() {
     printf("  * minseeks  - 32 seeks (use for floppy drives)\n");
     printf("  * size=x    - specify the test file size, which will be truncated to\n");
     printf("                available free space. To use all free space use 'maxsize'\n");
-    printf("                instead. Value is in bytes, specify K or M as required.\n");
-    printf("                examples: size=4M (default), size=16M, size=300K\n\n");
-    printf("Example: disktest size=8M maxseeks\n\n");
+    printf("                instead. Value is in bytes, specify K, M, G or T as required.\n");
+    printf("                examples: size=4M (default), size=16M, size=300K, size=1T\n");
+    printf("  * prealloc  - allocate the whole test file before the write test, so it\n");
+    printf("                measures writing rather than file system allocation\n");
+    printf("  * engine=x  - I/O engine: win32 (Windows default), posix (Linux default)\n");
+    printf("                or io_uring (Linux, asynchronous)\n");
+    printf("  * qd=n      - queue depth for random tests with io_uring, 1 to %d\n", MAX_QUEUE_DEPTH);
+    printf("  * qdsweep   - run random tests at QD 1, 2, 4... up to qd= (or %d)\n", MAX_QUEUE_DEPTH);
+    printf("  * bs=n      - transfer size for the sequential and random tests, up to 4M\n");
+    printf("                (default 32K sequential, 8K random)\n");
+    printf("  * bssweep   - run the sequential and random tests at 4K, 8K... 4M\n");
+    printf("  * rate=r    - issue random test IOs on a fixed timeline at r IOPS, or r bytes\n");
+    printf("                per second with K, M or G (rate=50M), and time each from when\n");
+    printf("                it was due\n");
+    printf("  * ratesweep - random test at 10%%, 20%%... 100%% of rate= (or of the\n");
+    printf("                flat out rate), with p50/p99/p99.9 latency at each\n");
+    printf("  * sync=n    - flush the test file after every n writes, and show commit\n");
+    printf("                latency: from each write's submission until it was durable\n");
+    printf("  * datasync  - with sync=, flush with fdatasync rather than fsync\n");
+    printf("  * groupcommit - with sync= and threads=, threads share flushes: one flush\n");
+    printf("                commits every thread's writes completed before it began\n");
+    printf("  * dsync     - open for O_DSYNC (write-through) writes, each durable when\n");
+    printf("                it completes\n");
+    printf("  * threads=n - run each test on n threads pinned to CPUs, each on its own\n");
+    printf("                slice of the test file, with per-thread results\n");
+    printf("  * perthreadfile - with threads=, give each thread its own test file\n");
+    printf("  * direct    - unbuffered I/O (O_DIRECT / FILE_FLAG_NO_BUFFERING), so reads\n");
+    printf("                come from the disk rather than the OS cache\n");
+    printf("  * output=json or output=csv - also write every test's configuration and\n");
+    printf("                results, with host and device details, to disktest.json or\n");
+    printf("                disktest.csv (outfile=name to change, outfile=- for stdout,\n");
+    printf("                with everything else on stderr)\n");
+    printf("  * seed=n    - seed for random offsets, to repeat a run exactly (the seed\n");
+    printf("                used is shown with the configuration)\n");
+    printf("  * permute   - random tests visit every block once, in random order,\n");
+    printf("                before repeating any\n");
+    printf("  * dist=d    - spread random test offsets: uniform (default), zipf:theta\n");
+    printf("                (zipf:0.99), hot:h:a (a%% of IOs to h%% of the file, hot:10:90)\n");
+    printf("                or jitter:j (sequential, each IO moved up to j blocks)\n");
+    printf("  * resume    - with mediatest, carry on from where an interrupted scan\n");
+    printf("                stopped (progress is kept in disktest.map, or mapfile=)\n");
+    printf("  * rescan=f  - with mediatest, test only the bad areas listed in error map f\n");
+    printf("  * unique    - with mediatest, write every block with its own header and\n");
+    printf("                data and find misplaced, stale or corrupt blocks\n");
+    printf("  * pipeline  - media test keeps qd= reads in flight while another thread\n");
+    printf("                verifies, to check at the drive's full speed\n");
+    printf("  * paths=a,b - test a file in each directory (or each file) listed, all at\n");
+    printf("                once with threads= per target, and show each target's share\n");
+    printf("  * target=t  - test device t (/dev/sdb, \\\\.\\PhysicalDrive1) or existing file t\n");
+    printf("                in place; writing tests ask first (overwrite to not ask)\n");
+    printf("  * mmap      - also run the read tests through a memory mapping of the\n");
+    printf("                file (engine=mmap runs every test that way)\n");
+    printf("  * madvise=h - hint for mapped tests: normal, sequential, random, willneed\n");
+    printf("  * populate  - fault the whole file in when it is mapped\n");
+    printf("  * mmaptouch - mapped tests touch one byte per page instead of copying\n");
+    printf("  * verifybench - measure the pattern fill and compare kernels and exit\n");
+    printf("  * selftest  - check the kernels, block checks, histogram and offset\n");
+    printf("                distributions against known answers, and exit\n");
+    printf("  * intervallog=f - write every test's throughput and latency for each\n");
+    printf("                interval to CSV file f, to plot how they changed\n");
+    printf("  * interval=ms - length of each logged interval (default 100)\n");
+    printf("  * metatest  - instead of the built-in tests, create, stat, read, rename and\n");
+    printf("                delete files= small files (default 10000) of filesize= (4K)\n");
+    printf("                in a tree fanout= (16) wide and depth= (2) deep under\n");
+    printf("                metadir= (default the current directory), on threads=\n");
+    printf("  * replay=f  - instead of the built-in tests, replay the IOs recorded in\n");
+    printf("                trace f at their original timing (speed=2 for twice as fast,\n");
+    printf("                speed=0 for as fast as possible), with each op's latency\n");
+    printf("  * import=s  - with replay=, first convert CSV or blkparse trace s into f\n");
+    printf("  * job=file  - run the workloads described in an INI job file instead of\n");
+    printf("                the built-in tests (see USAGE.md)\n");
+    printf("  * runtime=s - run each test for s seconds instead of a fixed IO count\n");
+    printf("  * ramp=s    - run s seconds of warm-up before each test starts counting\n");
+    printf("  * steady=p  - stop a test early once IOPS stays within p%% of its mean\n");
+    printf("  * steadywindow=s - seconds of results steady= looks at (default 5)\n\n");
+    printf("Example: disktest size=8M maxseeks\n");
+    printf("         disktest engine=io_uring qd=32 maxseeks\n");
+    printf("         disktest size=1G direct runtime=60 ramp=10 steady=2\n\n");
 }
 
 // Helper function to convert value to hex string
 std::string InHex(unsigned short value) {
     char buffer[8];
-    sprintf_s(buffer, sizeof(buffer), "0x%04X", value);
+    snprintf(buffer, sizeof(buffer), "0x%04X", value);
     return std::string(buffer);
 }
 
 // Helper function to format two digits
 std::string TwoDigit(int number) {
     char buffer[4];
-    sprintf_s(buffer, sizeof(buffer), "%02d", number);
+    snprintf(buffer, sizeof(buffer), "%02d", number);
     return std::string(buffer);
 }
 
-// Memory comparison function (equivalent to Pascal's COMPSW)
-int CompareWords(const void* source, const void* destination, int words) {
-    const unsigned short* src = (const unsigned short*)source;
-    const unsigned short* dst = (const unsigned short*)destination;
+// Pattern test function.  range limits it to some of the file's blocks, or
+// picks up part way through (NULL for the whole file from the start).  test
+// is the PATTERNS entry (1-based) whose errors and progress are recorded in
+// MediaErrors, or 0 to record nothing.
+long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned short>& readBlock, 
+                const std::string& displayStr, int mode, int test, const PatternRange* range) {
+    const long blockBytes = (long)(writeBlock.size() * sizeof(unsigned short));
+    PatternRange whole = {0, 0, 0, TestSize / blockBytes};
+    if (!range) range = &whole;
     
-    for (int i = 0; i < words; i++) {
-        if (src[i] != dst[i]) {
-            return words - i; // Return number of differing words
+    // Pipelined mode only pays off when there is verifying to overlap
+    std::unique_ptr<PatternPipeline> pipeline;
+    std::unique_ptr<IOEngine> file;
+    if (Pipeline && (mode & PAT_VERIFY)) {
+        pipeline.reset(new PatternPipeline());
+        if (!pipeline->Open(FName, EngineName, QueueDepth, Direct, writeBlock.data(), blockBytes)) {
+            printf("Pipelined mode unavailable; testing one block at a time.\n");
+            pipeline.reset();
         }
     }
-    return 0; // No differences
-}
-
-// Pattern test function
-long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned short>& readBlock, 
-                const std::string& displayStr, int mode) {
-    HANDLE hFile = CreateFileA(FName, GENERIC_READ | GENERIC_WRITE, 0, NULL, 
-                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        fprintf(stderr, "Failed to open test file for pattern test\n");
-        return -1;
+    if (!pipeline) {
+        file.reset(CreateEngine(NULL));
+        if (!file->Open(FName, IO_READ | IO_WRITE)) {
+            fprintf(stderr, "Failed to open test file for pattern test\n");
+            return -1;
+        }
     }
     
     long totalErrors = 0;
     long errCount = 0;
-    int max = TestSize / (32 * 1024); // Number of 32KB blocks
-    int readmax = max;
+    long long firstMismatch = -1; // File offset
+    long long badWords = 0;
+    long long first = range->first;
+    long long max = range->end;
+    long long readmax = max;
+    long long span = max > first ? max - first : 1;
     
     std::string testStr = displayStr + " - Writing: ";
     int dots = (78 - testStr.length() - 12) / 2; // Space for progress dots
     
     printf("%s", testStr.c_str());
     
-    COORD coord;
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
-    coord.X = csbi.dwCursorPosition.X;
-    coord.Y = csbi.dwCursorPosition.Y;
-    
     // Write phase
-    SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
     int currentDot = 0;
     
-    for (int io = 1; io <= max; io++) {
-        DWORD bytesWritten;
-        ::WriteFile(hFile, writeBlock.data(), writeBlock.size() * sizeof(unsigned short), 
-                 &bytesWritten, NULL);
+    // Unflushed writes may not survive a crash, so a scan interrupted while
+    // writing starts this pattern's writes again
+    if (test > 0) MediaErrors.Checkpoint(test, PHASE_WRITE, range->writeFrom);
+    for (long long io = range->writeFrom + 1; io <= max; io++) {
+        if (pipeline) {
+            if (!pipeline->Write((io - 1) * blockBytes)) {
+                // Read back only what was written; FinishWrites reports it
+                readmax = io - 1;
+                break;
+            }
+        } else {
+            file->Write(writeBlock.data(), blockBytes, (io - 1) * blockBytes);
+        }
         
         // Update progress
-        int next = (io * dots) / max;
+        int next = (int)(((io - first) * dots) / span);
         if (next > currentDot) {
             while (currentDot < next) {
                 printf(".");
@@ -511,8 +1708,8 @@ long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned s
         }
         
         // Check for user interrupt
-        if (_kbhit()) {
-            char ch = _getch();
+        if (KeyPressed()) {
+            char ch = (char)ReadKey();
             if (ch == ' ' || ch == 's' || ch == 'S') {
                 readmax = io;
                 break;
@@ -525,30 +1722,48 @@ long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned s
         }
     }
     
+    if (pipeline && !pipeline->FinishWrites()) {
+        printf(" write errors");
+        totalErrors++;
+    }
+    
     // Read and verify phase
     if (readmax > 0 && (mode & PAT_READ)) {
         printf(" Comparing: ");
-        SetFilePointer(hFile, 0, NULL, FILE_BEGIN);
         currentDot = 0;
+        if (pipeline) pipeline->StartVerify(range->readFrom, readmax);
         
-        COORD coord2;
-        GetConsoleScreenBufferInfo(hConsole, &csbi);
-        coord2.X = csbi.dwCursorPosition.X;
-        coord2.Y = csbi.dwCursorPosition.Y;
-        
-        for (int io = 1; io <= readmax; io++) {
-            DWORD bytesRead;
-            ::ReadFile(hFile, readBlock.data(), readBlock.size() * sizeof(unsigned short), 
-                    &bytesRead, NULL);
+        for (long long io = range->readFrom + 1; io <= readmax; io++) {
+            CompareResult result = {-1, 0};
+            if (pipeline) {
+                // Read ahead and compared on another thread already
+                if (!pipeline->NextVerified(result)) {
+                    // Not the media: the engine stopped, so the rest is unread
+                    printf(" read errors");
+                    totalErrors++;
+                    break;
+                }
+            } else {
+                file->Read(readBlock.data(), blockBytes, (io - 1) * blockBytes);
+                // Compare if verify mode is enabled
+                if (mode & PAT_VERIFY) {
+                    result = CompareBlocks(writeBlock.data(), readBlock.data(), blockBytes);
+                }
+            }
             
-            // Compare if verify mode is enabled
-            if (mode & PAT_VERIFY) {
-                errCount += CompareWords(writeBlock.data(), readBlock.data(), 
-                                       writeBlock.size());
+            if (result.badWords > 0) {
+                if (firstMismatch < 0) firstMismatch = (io - 1) * blockBytes + result.firstMismatch;
+                badWords += result.badWords;
+                errCount++;
+                totalErrors++;
+                if (test > 0) {
+                    MediaErrors.Add((io - 1) * blockBytes, test, writeBlock[0], result.badWords);
+                }
             }
+            if (test > 0) MediaErrors.Checkpoint(test, PHASE_READ, io);
             
             // Update progress
-            int next = (io * dots) / readmax;
+            int next = (int)(((io - first) * dots) / span);
             if (next > currentDot) {
                 while (currentDot < next) {
                     if (errCount == 0) {
@@ -558,16 +1773,12 @@ long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned s
                     }
                     currentDot++;
                 }
-                
-                if (errCount != 0) {
-                    totalErrors++;
-                    errCount = 0;
-                }
+                errCount = 0;
             }
             
             // Check for user interrupt
-            if (_kbhit()) {
-                char ch = _getch();
+            if (KeyPressed()) {
+                char ch = (char)ReadKey();
                 if (ch == 'q' || ch == 'Q') {
                     QUIT = true;
                     break;
@@ -577,55 +1788,106 @@ long PatternTest(std::vector<unsigned short>& writeBlock, std::vector<unsigned s
     }
     
     printf("\n");
-    CloseHandle(hFile);
+    if (badWords > 0) {
+        printf("  First mismatch at byte %lld; %lld bad words.\n", firstMismatch, badWords);
+    }
+    if (pipeline) {
+        pipeline->Stop();
+    } else {
+        file->Close();
+    }
     return totalErrors;
 }
 
+// Fill block with pattern test's (1-based) data and return its name
+std::string PreparePattern(int test, std::vector<unsigned short>& block) {
+    if (PATTERN_CYCLE[test - 1] == 1) {
+        // Walking pattern test
+        unsigned short pattern = PATTERNS[test - 1];
+        unsigned short walk[16];
+        for (int i = 0; i < 16; i++) {
+            walk[i] = (unsigned short)((pattern << i) | (pattern >> (16 - i)));
+        }
+        FillPattern(block.data(), 32768, walk, 16);
+        return PATTERN_NAMES[test - 1];
+    }
+    // Static pattern
+    FillPattern(block.data(), 32768, &PATTERNS[test - 1], 1);
+    return "Pattern " + InHex(PATTERNS[test - 1]);
+}
+
+// Summarise where the bad blocks are and how to look at them again
+void ShowErrorMap() {
+    std::vector<BadExtent> regions = MediaErrors.Regions();
+    if (regions.empty()) return;
+    const size_t MAX_SHOWN = 10;
+    printf("Bad areas:\n");
+    for (size_t i = 0; i < regions.size() && i < MAX_SHOWN; i++) {
+        printf("  Byte %lld, %lld KB, %lld bad words\n", regions[i].offset,
+               regions[i].length / 1024, regions[i].badWords);
+    }
+    if (regions.size() > MAX_SHOWN) {
+        printf("  ... and %d more\n", (int)(regions.size() - MAX_SHOWN));
+    }
+    printf("Every bad block is listed in %s; 'mediatest rescan=%s' tests just those.\n",
+           MediaErrors.Path().c_str(), MediaErrors.Path().c_str());
+}
+
 void MediaTest() {
+    std::vector<unsigned short> writeBlock(16384); // 32KB block
+    std::vector<unsigned short> readBlock(16384);
+    const long blockBytes = 32768;
+    const char* mapPath = ParamSpecified("mapfile=") ? GetParam("mapfile=") : DEFAULT_MAPFILE;
+    
+    // Pick up an interrupted scan where its last checkpoint left it
+    int startTest = 1;
+    PatternRange start = {0, 0, 0, 0};
+    bool resumed = false;
+    if (ParamSpecified("resume")) {
+        if (MediaErrors.Load(mapPath) && MediaErrors.HasCheckpoint() &&
+            MediaErrors.BlockBytes() == blockBytes) {
+            resumed = true;
+            TestSize = MediaErrors.Size();
+            startTest = MediaErrors.ResumeTest();
+            start.end = TestSize / blockBytes;
+            // Reading can carry on only if the pattern is still on the disk
+            if (MediaErrors.ResumePhase() == PHASE_READ && CheckTestFile() >= TestSize) {
+                start.writeFrom = start.end;
+                start.readFrom = MediaErrors.ResumeBlock();
+            }
+        } else {
+            printf("No unfinished scan in %s; starting from the beginning.\n", mapPath);
+        }
+    }
+    if (!resumed) MediaErrors.Reset(mapPath, TestSize, blockBytes);
+    
     printf("Pattern testing with %d patterns over ", PATTERN_TESTS);
     if (TestSize > 1048576) {
-        printf("%.1f MB.\n", TestSize / 1048576.0);
+        printf("%.1f MB", TestSize / 1048576.0);
     } else {
-        printf("%ld KB.\n", TestSize / 1024);
+        printf("%lld KB", TestSize / 1024);
     }
+    if (resumed) {
+        printf(", resuming at test %d %s block %lld", startTest,
+               start.writeFrom == start.end ? "read" : "write",
+               start.writeFrom == start.end ? start.readFrom : start.writeFrom);
+    }
+    printf(".\n");
     printf("Press any key to skip on, S to skip test completely, Q to quit.\n\n");
     
-    std::vector<unsigned short> writeBlock(16384); // 32KB block
-    std::vector<unsigned short> readBlock(16384);
     long errors = 0;
     QUIT = false;
     
-    LARGE_INTEGER testStart;
-    QueryPerformanceCounter(&testStart);
+    long long testStart = ClockNanos();
     
-    for (int test = 1; test <= PATTERN_TESTS; test++) {
-        // Fill array with pattern
-        if (PATTERN_CYCLE[test - 1] == 1) {
-            // Walking pattern test
-            unsigned short pattern = PATTERNS[test - 1];
-            for (int i = 0; i < 16384; i++) {
-                writeBlock[i] = (pattern << (i % 16)) | (pattern >> (16 - (i % 16)));
-            }
-        } else {
-            // Static pattern
-            for (int i = 0; i < 16384; i++) {
-                writeBlock[i] = PATTERNS[test - 1];
-            }
-        }
+    for (int test = startTest; test <= PATTERN_TESTS; test++) {
+        std::string displayStr = PreparePattern(test, writeBlock);
         
         // Copy to read buffer for comparison
         readBlock = writeBlock;
         
-        // Get test name
-        std::string displayStr;
-        if (PATTERN_CYCLE[test - 1] == 1) {
-            displayStr = PATTERN_NAMES[test - 1];
-        } else {
-            displayStr = "Pattern " + InHex(PATTERNS[test - 1]);
-        }
-        
         // Check RAM blocks for errors first
-        if (CompareWords(writeBlock.data(), readBlock.data(), 16384) != 0) {
+        if (CompareBlocks(writeBlock.data(), readBlock.data(), 32768).badWords != 0) {
             printf("RAM Error detected with %s.\n", displayStr.c_str());
             printf("Memory test failed - cannot continue pattern testing.\n");
             return;
@@ -633,7 +1895,8 @@ void MediaTest() {
         
         // Run the pattern test
         long testErrors = PatternTest(writeBlock, readBlock, displayStr, 
-                                    PAT_READ | PAT_WRITE | PAT_VERIFY);
+                                    PAT_READ | PAT_WRITE | PAT_VERIFY, test,
+                                    resumed && test == startTest ? &start : NULL);
         if (testErrors > 0) {
             errors += testErrors;
         }
@@ -642,9 +1905,7 @@ void MediaTest() {
     }
     
     // Calculate test time
-    LARGE_INTEGER testEnd;
-    QueryPerformanceCounter(&testEnd);
-    double testTime = (double)(testEnd.QuadPart - testStart.QuadPart) / frequency.QuadPart;
+    double testTime = (ClockNanos() - testStart) / 1e9;
     
     int hours = (int)(testTime / 3600);
     int minutes = ((int)testTime % 3600) / 60;
@@ -660,10 +1921,279 @@ void MediaTest() {
         printf("%ld 32K", errors);
     }
     printf(" blocks had errors.\n");
+    
+    if (QUIT) {
+        // Keep the file too, so the read phase can carry on
+        MediaErrors.Save();
+        KeepTestFile = true;
+        printf("Progress saved in %s; 'mediatest resume' carries on from here.\n", mapPath);
+    } else if (MediaErrors.Extents().empty()) {
+        remove(mapPath);
+    } else {
+        MediaErrors.Finish();
+    }
+    ShowErrorMap();
+}
+
+// Run every pattern again over just the areas a saved error map lists as
+// bad, and replace the map with what is still bad
+void RescanTest(const char* mapPath) {
+    std::vector<unsigned short> writeBlock(16384);
+    std::vector<unsigned short> readBlock(16384);
+    if (!MediaErrors.Load(mapPath)) return;
+    if (MediaErrors.BlockBytes() != 32768) {
+        printf("%s was not written by a media test.\n", mapPath);
+        return;
+    }
+    std::vector<BadExtent> regions = MediaErrors.Regions();
+    long long blockBytes = MediaErrors.BlockBytes();
+    TestSize = MediaErrors.Size();
+    if (regions.empty()) {
+        printf("%s lists no bad blocks.\n", mapPath);
+        return;
+    }
+    
+    printf("Rescanning %d bad area%s from %s with %d patterns.\n", (int)regions.size(),
+           regions.size() == 1 ? "" : "s", mapPath, PATTERN_TESTS);
+    printf("Press any key to skip on, S to skip test completely, Q to quit.\n\n");
+    
+    // No path while rescanning, so checkpoints never overwrite the map
+    // that is being rescanned
+    MediaErrors.Reset("", TestSize, (long)blockBytes);
+    QUIT = false;
+    for (size_t r = 0; r < regions.size() && !QUIT; r++) {
+        printf("Byte %lld, %lld KB:\n", regions[r].offset, regions[r].length / 1024);
+        PatternRange range;
+        range.first = range.writeFrom = range.readFrom = regions[r].offset / blockBytes;
+        range.end = (regions[r].offset + regions[r].length) / blockBytes;
+        for (int test = 1; test <= PATTERN_TESTS && !QUIT; test++) {
+            std::string displayStr = "  " + PreparePattern(test, writeBlock);
+            readBlock = writeBlock;
+            PatternTest(writeBlock, readBlock, displayStr, PAT_READ | PAT_WRITE | PAT_VERIFY,
+                        test, &range);
+        }
+    }
+    
+    printf("\n");
+    if (QUIT) {
+        printf("Rescan stopped; %s is unchanged.\n", mapPath);
+        return;
+    }
+    std::vector<BadExtent> still = MediaErrors.Regions();
+    printf("%d of %d area%s still bad.\n", (int)still.size(), (int)regions.size(),
+           regions.size() == 1 ? "" : "s");
+    MediaErrors.SetPath(mapPath);
+    MediaErrors.Finish();
+    ShowErrorMap();
+}
+
+// Write every block with its own header and payload, then read them all
+// back and check each is intact, in the right place and from this pass.
+// Two passes, so a write lost in the second shows up as stale data.
+void UniqueTest() {
+    const int PASSES = 2;
+    const long blockBytes = 32768;
+    const int MAX_SHOWN = 10;
+    
+    printf("Unique-data testing with %d passes over ", PASSES);
+    if (TestSize > 1048576) {
+        printf("%.1f MB", TestSize / 1048576.0);
+    } else {
+        printf("%lld KB", TestSize / 1024);
+    }
+    printf(", seed %llu, %s CRC32C.\n", Seed, Crc32cKernel());
+    printf("Press Q to quit.\n\n");
+    
+    long long max = TestSize / blockBytes;
+    long long counts[BLOCK_STATUSES] = {0, 0, 0, 0, 0};
+    int shown = 0;
+    long long unchecked = 0; // Blocks a write or read error kept from being checked
+    QUIT = false;
+    long long testStart = ClockNanos();
+    
+    for (int pass = 1; pass <= PASSES && !QUIT; pass++) {
+        PatternPipeline pipeline;
+        if (!pipeline.OpenUnique(FName, EngineName, QueueDepth, Direct, blockBytes, pass, Seed)) {
+            fprintf(stderr, "Failed to open test file for unique-data test\n");
+            return;
+        }
+        
+        std::string testStr = "Pass " + std::to_string(pass) + " - Writing: ";
+        int dots = (78 - (int)testStr.length() - 12) / 2;
+        printf("%s", testStr.c_str());
+        
+        long long readmax = max;
+        int currentDot = 0;
+        for (long long io = 1; io <= max; io++) {
+            if (!pipeline.Write((io - 1) * blockBytes)) {
+                // Check only what was written; FinishWrites reports it
+                readmax = io - 1;
+                unchecked += max - readmax;
+                break;
+            }
+            int next = (int)((io * dots) / max);
+            while (currentDot < next) {
+                printf(".");
+                currentDot++;
+            }
+            if (KeyPressed()) {
+                char ch = (char)ReadKey();
+                if (ch == 'q' || ch == 'Q') {
+                    QUIT = true;
+                    readmax = io;
+                    break;
+                }
+            }
+        }
+        if (!pipeline.FinishWrites()) {
+            printf(" write errors");
+        }
+        
+        printf(" Checking: ");
+        currentDot = 0;
+        bool dotBad = false;
+        pipeline.StartVerify(0, readmax);
+        for (long long io = 1; io <= readmax; io++) {
+            BlockCheck check;
+            if (!pipeline.NextChecked(check)) {
+                printf(" read errors");
+                unchecked += readmax - io + 1;
+                break;
+            }
+            counts[check.status]++;
+            if (check.status != BLOCK_GOOD) {
+                dotBad = true;
+                if (shown < MAX_SHOWN) {
+                    shown++;
+                    if (check.status == BLOCK_CORRUPT) {
+                        printf("\n  Block at byte %lld is corrupt", (io - 1) * blockBytes);
+                    } else {
+                        printf("\n  Block at byte %lld is %s: holds byte %lld from pass %llu",
+                               (io - 1) * blockBytes, BLOCK_STATUS_NAMES[check.status],
+                               check.foundOffset, check.foundGeneration);
+                    }
+                }
+            }
+            int next = (int)((io * dots) / readmax);
+            while (currentDot < next) {
+                printf(dotBad ? "!" : "*");
+                dotBad = false;
+                currentDot++;
+            }
+        }
+        printf("\n");
+    }
+    
+    double testTime = (ClockNanos() - testStart) / 1e9;
+    printf("\nTest ran for %.1f s. ", testTime);
+    long long bad = counts[BLOCK_CORRUPT] + counts[BLOCK_MISPLACED] + counts[BLOCK_STALE] +
+                    counts[BLOCK_FOREIGN];
+    if (unchecked > 0) printf("%lld blocks could not be checked. ", unchecked);
+    if (bad == 0) {
+        printf("No blocks had errors.\n");
+    } else {
+        printf("%lld 32K blocks had errors:", bad);
+        for (int status = BLOCK_CORRUPT; status <= BLOCK_FOREIGN; status++) {
+            if (counts[status] > 0) {
+                printf(" %lld %s", counts[status], BLOCK_STATUS_NAMES[status]);
+            }
+        }
+        printf(".\n");
+    }
+}
+
+// Fill and compare throughput of each pattern kernel this processor runs,
+// on a 32K block (as the media test uses, in cache) and on a buffer too
+// big for the caches.  No disk access.
+void VerifyBenchmark() {
+    const size_t sizes[2] = {32768, 64 * 1024 * 1024};
+    const double RUN_SECONDS = 0.5;
+    int count;
+    const VerifyKernel* kernels = VerifyKernels(count);
+    
+    unsigned char* expected = (unsigned char*)AlignedAlloc(sizes[1], PageSize());
+    unsigned char* actual = (unsigned char*)AlignedAlloc(sizes[1], PageSize());
+    if (!expected || !actual) {
+        printf("Out of memory for the benchmark buffers.\n");
+        AlignedFree(expected);
+        AlignedFree(actual);
+        return;
+    }
+    unsigned char period[PATTERN_PERIOD];
+    for (int i = 0; i < PATTERN_PERIOD; i++) period[i] = (unsigned char)(0xA5 ^ i);
+    kernels[0].fill(expected, sizes[1], period);
+    kernels[0].fill(actual, sizes[1], period);
+    
+    if (!CheckKernels()) {
+        printf("The kernels do not agree; not benchmarking them.\n");
+        AlignedFree(expected);
+        AlignedFree(actual);
+        return;
+    }
+    printf("Pattern kernel throughput, GB/s:\n\n");
+    printf("  Kernel    32K fill   32K compare   64M fill   64M compare\n");
+    for (int k = 0; k < count; k++) {
+        printf("  %-8s", kernels[k].name);
+        for (int s = 0; s < 2; s++) {
+            double rates[2];
+            for (int op = 0; op < 2; op++) {
+                long long bytes = 0;
+                long long start = ClockNanos();
+                long long end = start + (long long)(RUN_SECONDS * 1e9);
+                long long now;
+                do {
+                    if (op == 0) {
+                        kernels[k].fill(actual, sizes[s], period);
+                    } else if (kernels[k].compare(expected, actual, sizes[s]).badWords != 0) {
+                        printf("\n%s kernel compare failed.\n", kernels[k].name);
+                    }
+                    bytes += (long long)sizes[s];
+                    now = ClockNanos();
+                } while (now < end);
+                rates[op] = bytes / ((now - start) / 1e9) / 1e9;
+            }
+            printf(" %10.2f %13.2f", rates[0], rates[1]);
+        }
+        printf("\n");
+    }
+    printf("\nThe media and signal tests use the %s kernel.\n", kernels[count - 1].name);
+    
+    // The unique-data test checksums every block it reads
+    long long bytes = 0;
+    unsigned int crc = 0;
+    long long start = ClockNanos();
+    long long end = start + (long long)(RUN_SECONDS * 1e9);
+    long long now;
+    do {
+        crc = Crc32c(actual, sizes[1], crc);
+        bytes += (long long)sizes[1];
+        now = ClockNanos();
+    } while (now < end);
+    printf("CRC32C (%s): %.2f GB/s\n", Crc32cKernel(), bytes / ((now - start) / 1e9) / 1e9);
+    
+    AlignedFree(expected);
+    AlignedFree(actual);
+}
+
+// Known-answer checks of the code the tests trust to find errors and
+// measure latency, for ctest; no disk access
+bool SelfTest() {
+    int count;
+    const VerifyKernel* kernels = VerifyKernels(count);
+    printf("Checking CRC32C (%s) and the", Crc32cKernel());
+    for (int k = 0; k < count; k++) printf(" %s", kernels[k].name);
+    printf(" kernels...\n");
+    bool ok = CheckKernels();
+    printf("Checking unique-data blocks, the latency histogram and offset distributions...\n");
+    ok &= CheckBlocks();
+    ok &= CheckHistogram();
+    ok &= CheckDistributions();
+    printf(ok ? "All checks passed.\n" : "Self test FAILED.\n");
+    return ok;
 }
 
 void SignalTest() {
-    printf("XT/IDE Development Pattern Tests - using %ld MB test file.\n", TestSize / 1048576);
+    printf("XT/IDE Development Pattern Tests - using %lld MB test file.\n", TestSize / 1048576);
     
     std::vector<unsigned short> writeBlock(16384);
     std::vector<unsigned short> readBlock(16384);
@@ -691,8 +2221,9 @@ void SignalTest() {
         
         char ch;
         do {
-            ch = _getch();
-            ch = toupper(ch);
+            int key = ReadKey();
+            if (key < 0) key = 'E'; // No console; end the test
+            ch = (char)toupper(key);
         } while (ch != '1' && ch != '2' && ch != '3' && ch != '4' && ch != '5' && 
                  ch != 'E' && ch != 'Q');
         
@@ -703,29 +2234,24 @@ void SignalTest() {
         } else {
             // Fill buffer based on choice
             switch (ch) {
-                case '1':
-                    for (int i = 0; i < 16384; i += 2) {
-                        writeBlock[i] = 0x0080;
-                        writeBlock[i + 1] = 0x0000;
-                    }
+                case '1': {
+                    const unsigned short words[2] = {0x0080, 0x0000};
+                    FillPattern(writeBlock.data(), 32768, words, 2);
                     break;
-                case '2':
-                    for (int i = 0; i < 16384; i += 2) {
-                        writeBlock[i] = 0xF7FF;
-                        writeBlock[i + 1] = 0x0000;
-                    }
+                }
+                case '2': {
+                    const unsigned short words[2] = {0xF7FF, 0x0000};
+                    FillPattern(writeBlock.data(), 32768, words, 2);
                     break;
-                case '3':
-                    for (int i = 0; i < 16384; i++) {
-                        writeBlock[i] = 0x1000;
-                    }
+                }
+                case '3': {
+                    const unsigned short word = 0x1000;
+                    FillPattern(writeBlock.data(), 32768, &word, 1);
                     break;
+                }
                 case '4':
                 case '5':
-                    for (int i = 0; i < 16384; i += 2) {
-                        writeBlock[i] = POWER_PATTERNS[0];
-                        writeBlock[i + 1] = POWER_PATTERNS[1];
-                    }
+                    FillPattern(writeBlock.data(), 32768, POWER_PATTERNS, 2);
                     break;
             }
             
@@ -745,7 +2271,7 @@ void SignalTest() {
                 testMode |= PAT_READ_CONTINUOUS;
             }
             
-            long testErrors = PatternTest(writeBlock, readBlock, displayStr, testMode);
+            long testErrors = PatternTest(writeBlock, readBlock, displayStr, testMode, 0, NULL);
             if (testErrors > 0) {
                 errors += testErrors;
             }
@@ -0,0 +1,252 @@
+/*
+ * DiskTest - offset distributions
+ */
+
+#include "distribution.h"
+#include "platform.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+
+// Most buckets a Zipf table has; half are single ranks, half the tail
+const unsigned MAX_BUCKETS = 1 << 18;
+
+bool ParseDistribution(const char* s, DistributionSpec& spec) {
+    spec.kind = DIST_UNIFORM;
+    spec.theta = spec.hotPercent = spec.hotIOs = 0;
+    spec.jitter = 0;
+    char* end;
+    if (_stricmp(s, "uniform") == 0) return true;
+    if (_strnicmp(s, "zipf:", 5) == 0) {
+        spec.kind = DIST_ZIPF;
+        spec.theta = strtod(s + 5, &end);
+        return end != s + 5 && *end == '\0' && spec.theta > 0 && spec.theta <= 10;
+    }
+    if (_strnicmp(s, "hot:", 4) == 0) {
+        spec.kind = DIST_HOTCOLD;
+        spec.hotPercent = strtod(s + 4, &end);
+        if (end == s + 4 || *end != ':') return false;
+        const char* ios = end + 1;
+        spec.hotIOs = strtod(ios, &end);
+        return end != ios && *end == '\0' && spec.hotPercent > 0 && spec.hotPercent < 100 &&
+               spec.hotIOs >= 0 && spec.hotIOs <= 100;
+    }
+    if (_strnicmp(s, "jitter:", 7) == 0) {
+        spec.kind = DIST_JITTER;
+        spec.jitter = strtoll(s + 7, &end, 10);
+        return end != s + 7 && *end == '\0' && spec.jitter >= 0;
+    }
+    return false;
+}
+
+std::string DistributionName(const DistributionSpec& spec) {
+    char name[64];
+    switch (spec.kind) {
+    case DIST_ZIPF:
+        snprintf(name, sizeof(name), "zipf:%g", spec.theta);
+        break;
+    case DIST_HOTCOLD:
+        snprintf(name, sizeof(name), "hot:%g:%g", spec.hotPercent, spec.hotIOs);
+        break;
+    case DIST_JITTER:
+        snprintf(name, sizeof(name), "jitter:%lld", spec.jitter);
+        break;
+    default:
+        return "uniform";
+    }
+    return name;
+}
+
+// Vose's method: scale the weights so they average 1, then pair each
+// bucket under 1 with one over, which gives it the rest of its column
+void AliasTable::Init(const std::vector<double>& weights) {
+    size_t n = weights.size();
+    probability.assign(n, 1.0);
+    alias.resize(n);
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) sum += weights[i];
+    std::vector<double> scaled(n);
+    std::vector<unsigned> small, large;
+    for (size_t i = 0; i < n; i++) {
+        alias[i] = (unsigned)i;
+        scaled[i] = sum > 0 ? weights[i] * n / sum : 1;
+        if (scaled[i] < 1) {
+            small.push_back((unsigned)i);
+        } else {
+            large.push_back((unsigned)i);
+        }
+    }
+    while (!small.empty() && !large.empty()) {
+        unsigned less = small.back(), more = large.back();
+        small.pop_back();
+        probability[less] = scaled[less];
+        alias[less] = more;
+        scaled[more] -= 1 - scaled[less];
+        if (scaled[more] < 1) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Whatever is left is 1 but for rounding
+}
+
+unsigned AliasTable::Sample(Random& random) const {
+    unsigned i = (unsigned)random.Below(probability.size());
+    double u = (random.Next() >> 11) * (1.0 / 9007199254740992.0); // [0, 1), 53 bits
+    return u < probability[i] ? i : alias[i];
+}
+
+// Sum of 1 / k^theta for k from a + 1 to b, the Zipf weight of ranks
+// [a, b): exact for one rank, otherwise the integral, which is very close
+// over the narrow tail buckets
+static double ZipfWeight(unsigned long long a, unsigned long long b, double theta) {
+    if (b == a + 1) return pow((double)b, -theta);
+    double low = a + 0.5, high = b + 0.5;
+    if (fabs(theta - 1) < 1e-9) return log(high / low);
+    return (pow(high, 1 - theta) - pow(low, 1 - theta)) / (1 - theta);
+}
+
+BlockDistribution::BlockDistribution() : blocks(1), key(0), mask(0), shift(1) {
+    spec.kind = DIST_UNIFORM;
+}
+
+void BlockDistribution::Init(const DistributionSpec& distribution, unsigned long long count,
+                             unsigned long long scatterKey) {
+    spec = distribution;
+    blocks = count > 0 ? count : 1;
+    int bits = 1;
+    while (bits < 64 && (1ULL << bits) < blocks) bits++;
+    mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+    shift = bits / 2 + 1;
+    key = scatterKey & mask;
+
+    first.clear();
+    std::vector<double> weights;
+    if (spec.kind == DIST_ZIPF) {
+        // Single ranks up to head, then the tail in geometric steps
+        unsigned long long head = blocks <= MAX_BUCKETS ? blocks : MAX_BUCKETS / 2;
+        for (unsigned long long r = 0; r < head; r++) first.push_back(r);
+        unsigned tail = MAX_BUCKETS - (unsigned)head;
+        double ratio = blocks > head ? pow((double)blocks / head, 1.0 / tail) : 1;
+        double edge = (double)head;
+        for (unsigned i = 0; i < tail && blocks > head; i++) {
+            unsigned long long start = (unsigned long long)edge;
+            if (start > first.back() && start < blocks) first.push_back(start);
+            edge *= ratio;
+        }
+        first.push_back(blocks);
+        for (size_t i = 0; i + 1 < first.size(); i++) {
+            weights.push_back(ZipfWeight(first[i], first[i + 1], spec.theta));
+        }
+    } else if (spec.kind == DIST_HOTCOLD) {
+        unsigned long long hot = (unsigned long long)(blocks * spec.hotPercent / 100);
+        if (hot < 1) hot = 1;
+        first.push_back(0);
+        weights.push_back(spec.hotIOs);
+        if (hot < blocks) {
+            first.push_back(hot);
+            weights.push_back(100 - spec.hotIOs);
+        }
+        first.push_back(blocks);
+    }
+    if (!weights.empty()) table.Init(weights);
+}
+
+// A bijection on [0, blocks): a keyed xorshift-multiply mix on the next
+// power of two, repeated until it lands below blocks (cycle walking)
+unsigned long long BlockDistribution::Scatter(unsigned long long rank) const {
+    unsigned long long x = rank;
+    do {
+        x ^= key;
+        x ^= x >> shift;
+        x = (x * 0xD6E8FEB86659FD93ULL) & mask;
+        x ^= x >> shift;
+    } while (x >= blocks);
+    return x;
+}
+
+unsigned long long BlockDistribution::Next(Random& random, long long issued) const {
+    switch (spec.kind) {
+    case DIST_ZIPF:
+    case DIST_HOTCOLD: {
+        unsigned bucket = table.Sample(random);
+        unsigned long long rank = first[bucket] + random.Below(first[bucket + 1] - first[bucket]);
+        return Scatter(rank);
+    }
+    case DIST_JITTER: {
+        long long move = (long long)random.Below(2 * spec.jitter + 1) - spec.jitter;
+        long long block = (issued + move) % (long long)blocks;
+        return block < 0 ? block + blocks : block;
+    }
+    default:
+        return random.Below(blocks);
+    }
+}
+
+// Fraction of draws within five standard deviations of expected
+static bool Close(const char* what, double fraction, double expected, int draws) {
+    if (fabs(fraction - expected) <= 5 * sqrt(expected * (1 - expected) / draws)) return true;
+    printf("%s: %.4f of draws; expected %.4f\n", what, fraction, expected);
+    return false;
+}
+
+bool CheckDistributions() {
+    const int DRAWS = 1000000;
+    bool ok = true;
+    Random random(7);
+
+    // Weights 1 to 4 and a 0, which must never be drawn
+    std::vector<double> weights;
+    for (int i = 1; i <= 4; i++) weights.push_back(i);
+    weights.push_back(0);
+    AliasTable table;
+    table.Init(weights);
+    std::vector<int> drawn(weights.size(), 0);
+    for (int i = 0; i < DRAWS; i++) drawn[table.Sample(random)]++;
+    for (size_t i = 0; i < weights.size(); i++) {
+        ok &= Close("Alias table bucket", (double)drawn[i] / DRAWS, weights[i] / 10, DRAWS);
+    }
+
+    // Blocks are scattered, so rank them by how often they were drawn; a
+    // block drawn for two ranks would throw the top ranks out
+    const unsigned long long BLOCKS = 1000;
+    DistributionSpec spec;
+    ParseDistribution("zipf:0.99", spec);
+    BlockDistribution zipf;
+    zipf.Init(spec, BLOCKS, 12345);
+    std::vector<int> counts(BLOCKS, 0);
+    for (int i = 0; i < DRAWS; i++) counts[zipf.Next(random, i)]++;
+    std::sort(counts.begin(), counts.end(), std::greater<int>());
+    double total = 0;
+    for (unsigned long long r = 1; r <= BLOCKS; r++) total += pow((double)r, -0.99);
+    for (unsigned long long r = 1; r <= 4; r++) {
+        ok &= Close("Zipf rank", (double)counts[r - 1] / DRAWS, pow((double)r, -0.99) / total,
+                    DRAWS);
+    }
+
+    // 90% of IOs to the hottest 10% of blocks
+    ParseDistribution("hot:10:90", spec);
+    BlockDistribution hot;
+    hot.Init(spec, BLOCKS, 12345);
+    counts.assign(BLOCKS, 0);
+    for (int i = 0; i < DRAWS; i++) counts[hot.Next(random, i)]++;
+    std::sort(counts.begin(), counts.end(), std::greater<int>());
+    long long hottest = 0;
+    for (unsigned long long b = 0; b < BLOCKS / 10; b++) hottest += counts[b];
+    ok &= Close("Hot blocks", (double)hottest / DRAWS, 0.9, DRAWS);
+
+    // A file too large for a bucket per rank still draws every block in range
+    ParseDistribution("zipf:1.2", spec);
+    BlockDistribution large;
+    large.Init(spec, 3000000007ULL, 99);
+    for (int i = 0; i < DRAWS / 10; i++) {
+        if (large.Next(random, i) >= 3000000007ULL) {
+            printf("Zipf draw beyond the end of the file.\n");
+            ok = false;
+            break;
+        }
+    }
+    return ok;
+}
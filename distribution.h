@@ -0,0 +1,85 @@
+/*
+ * DiskTest - offset distributions
+ *
+ * Random tests normally spread their IOs evenly over the file, which no
+ * real cache ever sees.  A BlockDistribution skews them instead:
+ *
+ *   zipf:theta   block ranks drawn with probability 1 / rank^theta, as
+ *                YCSB does (theta 0.99 is its default)
+ *   hot:h:a      a percent of the IOs go to h percent of the blocks
+ *   jitter:j     sequential, each IO moved by up to j blocks either way
+ *
+ * Zipf and hot/cold are both weighted buckets of consecutive ranks.  A
+ * bucket is picked in O(1) from a Walker/Vose alias table, then a rank
+ * uniformly within it.  Zipf's first ranks, which carry most of the
+ * weight, get a bucket each; the long tail shares buckets of geometrically
+ * growing width, in which the weights hardly differ, so the table stays a
+ * few megabytes however large the file.  Ranks are then scattered over the
+ * file by a keyed bijection, so the hot blocks are not all at its start.
+ *
+ * The tables depend only on the workload, so one distribution is built per
+ * run and shared, read-only, by every thread; each draws with its own
+ * Random.
+ */
+
+#ifndef DISKTEST_DISTRIBUTION_H
+#define DISKTEST_DISTRIBUTION_H
+
+#include "random.h"
+#include <string>
+#include <vector>
+
+enum DistributionKind { DIST_UNIFORM, DIST_ZIPF, DIST_HOTCOLD, DIST_JITTER };
+
+struct DistributionSpec {
+    int kind;             // DistributionKind
+    double theta;         // Zipf exponent
+    double hotPercent;    // Percent of blocks that are hot
+    double hotIOs;        // Percent of IOs that go to them
+    long long jitter;     // Blocks either side of the sequential position
+};
+
+// Parse a dist= value: uniform, zipf:theta, hot:h:a or jitter:j
+bool ParseDistribution(const char* s, DistributionSpec& spec);
+// The same form back, for reports
+std::string DistributionName(const DistributionSpec& spec);
+
+// Picks bucket i with probability weights[i] / their sum
+class AliasTable {
+public:
+    void Init(const std::vector<double>& weights);
+    unsigned Sample(Random& random) const;
+
+private:
+    std::vector<double> probability;
+    std::vector<unsigned> alias;
+};
+
+class BlockDistribution {
+public:
+    BlockDistribution();
+
+    // Set up for blocks blocks; key places the hot ranks
+    void Init(const DistributionSpec& spec, unsigned long long blocks, unsigned long long key);
+
+    // Block index in [0, blocks) for IO number issued of a thread
+    unsigned long long Next(Random& random, long long issued) const;
+
+private:
+    unsigned long long Scatter(unsigned long long rank) const;
+
+    DistributionSpec spec;
+    unsigned long long blocks;
+    AliasTable table;
+    std::vector<unsigned long long> first; // First rank of each bucket, then blocks
+    unsigned long long key;
+    unsigned long long mask;
+    int shift;
+};
+
+// Draw from an alias table and from Zipf and hot/cold distributions and
+// check the frequencies against their weights.  Prints each failure; true
+// if there were none.
+bool CheckDistributions();
+
+#endif // DISKTEST_DISTRIBUTION_H
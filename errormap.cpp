@@ -0,0 +1,181 @@
+/*
+ * DiskTest - media test error map and checkpoints
+ */
+
+#include "errormap.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+
+// Checkpoints are written at most this often during a scan
+const double CHECKPOINT_SECONDS = 30;
+
+static const char* PHASE_NAMES[] = {"write", "read"};
+
+static std::string Trim(const std::string& s) {
+    size_t first = 0, last = s.size();
+    while (first < last && isspace((unsigned char)s[first])) first++;
+    while (last > first && isspace((unsigned char)s[last - 1])) last--;
+    return s.substr(first, last - first);
+}
+
+ErrorMap::ErrorMap()
+    : size(0), blockBytes(0), resumeTest(0), resumePhase(PHASE_WRITE), resumeBlock(0),
+      lastSave(0) {
+}
+
+void ErrorMap::Reset(const char* file, long long bytes, long block) {
+    path = file;
+    size = bytes;
+    blockBytes = block;
+    extents.clear();
+    resumeTest = 0;
+    resumePhase = PHASE_WRITE;
+    resumeBlock = 0;
+    lastSave = ClockNanos();
+}
+
+bool ErrorMap::Load(const char* file) {
+    FILE* f = fopen(file, "r");
+    if (!f) {
+        printf("Cannot open error map %s\n", file);
+        return false;
+    }
+    Reset(file, 0, 0);
+
+    char line[256];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        std::string text = line;
+        size_t comment = text.find(';');
+        if (comment != std::string::npos) text.erase(comment);
+        text = Trim(text);
+        if (text.empty()) continue;
+
+        size_t equals = text.find('=');
+        std::string key = Trim(text.substr(0, equals));
+        const char* value = equals == std::string::npos ? "" : text.c_str() + equals + 1;
+        if (key == "size") {
+            ok = sscanf(value, "%lld", &size) == 1 && size > 0;
+        } else if (key == "block") {
+            ok = sscanf(value, "%ld", &blockBytes) == 1 && blockBytes > 0;
+        } else if (key == "resume") {
+            char phase[16];
+            ok = sscanf(value, "%d %15s %lld", &resumeTest, phase, &resumeBlock) == 3 &&
+                 resumeTest > 0 && resumeBlock >= 0;
+            if (ok && strcmp(phase, PHASE_NAMES[PHASE_WRITE]) == 0) {
+                resumePhase = PHASE_WRITE;
+            } else if (ok && strcmp(phase, PHASE_NAMES[PHASE_READ]) == 0) {
+                resumePhase = PHASE_READ;
+            } else {
+                ok = false;
+            }
+        } else if (key == "bad") {
+            BadExtent extent;
+            unsigned int pattern;
+            ok = sscanf(value, "%lld %lld %d %x %lld", &extent.offset, &extent.length,
+                        &extent.test, &pattern, &extent.badWords) == 5 &&
+                 extent.offset >= 0 && extent.length > 0;
+            extent.pattern = (unsigned short)pattern;
+            if (ok) extents.push_back(extent);
+        } else {
+            ok = false;
+        }
+        if (!ok) printf("%s line %d: not a valid error map entry\n", file, lineNumber);
+    }
+    fclose(f);
+
+    if (ok && (size <= 0 || blockBytes <= 0)) {
+        printf("%s has no size or block size\n", file);
+        ok = false;
+    }
+    return ok;
+}
+
+// Written to a new file and renamed over the old, so an interruption part
+// way through a save leaves the previous map intact
+bool ErrorMap::Save() {
+    lastSave = ClockNanos();
+    if (path.empty()) return false;
+    std::string temp = path + ".new";
+    FILE* f = fopen(temp.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "Cannot write error map %s\n", temp.c_str());
+        return false;
+    }
+    fprintf(f, "; DiskTest media error map\n");
+    fprintf(f, "size=%lld\n", size);
+    fprintf(f, "block=%ld\n", blockBytes);
+    if (resumeTest > 0) {
+        fprintf(f, "resume=%d %s %lld\n", resumeTest, PHASE_NAMES[resumePhase], resumeBlock);
+    }
+    for (size_t i = 0; i < extents.size(); i++) {
+        const BadExtent& e = extents[i];
+        fprintf(f, "bad=%lld %lld %d 0x%04X %lld\n", e.offset, e.length, e.test, e.pattern,
+                e.badWords);
+    }
+    bool ok = fflush(f) == 0;
+    fclose(f);
+#ifdef _WIN32
+    remove(path.c_str()); // rename() will not replace a file on Windows
+#endif
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Cannot write error map %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ErrorMap::Add(long long offset, int test, unsigned short pattern, long long badWords) {
+    if (!extents.empty()) {
+        BadExtent& last = extents.back();
+        if (last.test == test && last.offset + last.length == offset) {
+            last.length += blockBytes;
+            last.badWords += badWords;
+            return;
+        }
+    }
+    BadExtent extent = {offset, blockBytes, test, pattern, badWords};
+    extents.push_back(extent);
+}
+
+void ErrorMap::Checkpoint(int test, int phase, long long block) {
+    resumeTest = test;
+    resumePhase = phase;
+    resumeBlock = block;
+    if ((ClockNanos() - lastSave) / 1e9 >= CHECKPOINT_SECONDS) Save();
+}
+
+void ErrorMap::Finish() {
+    resumeTest = 0;
+    Save();
+}
+
+static bool ByOffset(const BadExtent& a, const BadExtent& b) {
+    return a.offset < b.offset;
+}
+
+std::vector<BadExtent> ErrorMap::Regions() const {
+    std::vector<BadExtent> sorted = extents;
+    std::sort(sorted.begin(), sorted.end(), ByOffset);
+    std::vector<BadExtent> regions;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        if (!regions.empty()) {
+            BadExtent& last = regions.back();
+            if (sorted[i].offset <= last.offset + last.length) {
+                long long end = std::max(last.offset + last.length,
+                                         sorted[i].offset + sorted[i].length);
+                last.length = end - last.offset;
+                last.badWords += sorted[i].badWords;
+                continue;
+            }
+        }
+        regions.push_back(sorted[i]);
+    }
+    return regions;
+}
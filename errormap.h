@@ -0,0 +1,80 @@
+/*
+ * DiskTest - media test error map and checkpoints
+ *
+ * A multi-hour media scan is only useful if it says where the bad blocks
+ * are, and it should not have to start over after an interruption.  The
+ * ErrorMap records every failing block as an extent (consecutive bad blocks
+ * under the same pattern merge into one), together with how far the scan
+ * has got, and keeps both in a small text file:
+ *
+ *   ; DiskTest media error map
+ *   size=68719476736
+ *   block=32768
+ *   resume=4 read 180224       ; pattern test, phase, next block
+ *   bad=1048576 65536 2 0xFFFF 40960
+ *                              ; offset, bytes, pattern test, pattern, bad words
+ *
+ * The resume line is there only while a scan is unfinished.
+ */
+
+#ifndef DISKTEST_ERRORMAP_H
+#define DISKTEST_ERRORMAP_H
+
+#include <string>
+#include <vector>
+
+struct BadExtent {
+    long long offset;       // Bytes
+    long long length;       // Bytes, a multiple of the block size
+    int test;               // Pattern test (1-based) that found it
+    unsigned short pattern;
+    long long badWords;
+};
+
+// Where an unfinished scan picks up
+enum ScanPhase { PHASE_WRITE, PHASE_READ };
+
+class ErrorMap {
+public:
+    ErrorMap();
+
+    // Start an empty map for a scan of size bytes, saved to path
+    void Reset(const char* path, long long size, long blockBytes);
+    // Read a saved map; reports the first error with its line number
+    bool Load(const char* path);
+    bool Save();
+
+    // Record a failing block at offset
+    void Add(long long offset, int test, unsigned short pattern, long long badWords);
+
+    // The scan has reached block in test and phase; saved now and then
+    void Checkpoint(int test, int phase, long long block);
+    // The scan finished, or the map is final: drop the resume point and save
+    void Finish();
+
+    bool HasCheckpoint() const { return resumeTest > 0; }
+    int ResumeTest() const { return resumeTest; }
+    int ResumePhase() const { return resumePhase; }
+    long long ResumeBlock() const { return resumeBlock; }
+
+    long long Size() const { return size; }
+    long BlockBytes() const { return blockBytes; }
+    const std::string& Path() const { return path; }
+    void SetPath(const char* file) { path = file; }
+    const std::vector<BadExtent>& Extents() const { return extents; }
+
+    // Bad areas whatever the pattern, merged and in offset order
+    std::vector<BadExtent> Regions() const;
+
+private:
+    std::string path;
+    long long size;
+    long blockBytes;
+    std::vector<BadExtent> extents;
+    int resumeTest;               // 0 if none
+    int resumePhase;
+    long long resumeBlock;
+    long long lastSave;           // ClockNanos
+};
+
+#endif // DISKTEST_ERRORMAP_H
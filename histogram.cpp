@@ -0,0 +1,138 @@
+/*
+ * DiskTest - latency histogram
+ */
+
+#include "histogram.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the highest set bit of a non-zero value
+static inline int HighBit(unsigned long long v) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#else
+    int bit = 0;
+    while (v >>= 1) bit++;
+    return bit;
+#endif
+}
+
+// Values below 2 * HISTOGRAM_SUB_BUCKETS get a bucket each; above that,
+// each power of two shares HISTOGRAM_SUB_BUCKETS buckets.
+static inline int BucketIndex(unsigned long long v) {
+    if (v < (unsigned long long)(2 * HISTOGRAM_SUB_BUCKETS)) return (int)v;
+    int shift = HighBit(v) - HISTOGRAM_SUB_BITS;
+    return (shift << HISTOGRAM_SUB_BITS) + (int)(v >> shift);
+}
+
+// Middle of the range of values that land in bucket index
+static long long BucketValue(int index) {
+    if (index < 2 * HISTOGRAM_SUB_BUCKETS) return index;
+    int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+    long long mantissa = index - (shift << HISTOGRAM_SUB_BITS);
+    return (mantissa << shift) + ((1LL << shift) >> 1);
+}
+
+Histogram::Histogram() {
+    Reset();
+}
+
+void Histogram::Reset() {
+    count = 0;
+    sum = 0;
+    minValue = 0;
+    maxValue = 0;
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void Histogram::Record(long long value) {
+    if (value < 0) value = 0;
+    buckets[BucketIndex((unsigned long long)value)]++;
+    if (count == 0 || value < minValue) minValue = value;
+    if (value > maxValue) maxValue = value;
+    sum += value;
+    count++;
+}
+
+void Histogram::Merge(const Histogram& other) {
+    if (other.count == 0) return;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        buckets[i] += other.buckets[i];
+    }
+    if (count == 0 || other.minValue < minValue) minValue = other.minValue;
+    if (other.maxValue > maxValue) maxValue = other.maxValue;
+    sum += other.sum;
+    count += other.count;
+}
+
+long long Histogram::Percentile(double percent) const {
+    if (count == 0) return 0;
+
+    long long target = (long long)(percent / 100.0 * count + 0.5);
+    if (target < 1) target = 1;
+    if (target > count) target = count;
+
+    long long seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            // Bucket midpoints can fall outside what was actually seen
+            long long value = BucketValue(i);
+            if (value < minValue) value = minValue;
+            if (value > maxValue) value = maxValue;
+            return value;
+        }
+    }
+    return maxValue;
+}
+
+// True if value is within half a bucket of want: a 64th
+static bool Near(const char* what, long long value, long long want) {
+    long long error = value > want ? value - want : want - value;
+    if (error <= want / 64) return true;
+    printf("Histogram %s is %lld; expected %lld\n", what, value, want);
+    return false;
+}
+
+bool CheckHistogram() {
+    bool ok = true;
+    // Below 64 every value has its own bucket, so percentiles are exact
+    Histogram small;
+    for (int v = 0; v < 64; v++) small.Record(v);
+    if (small.Percentile(50) != 31 || small.Percentile(0) != 0 || small.Percentile(100) != 63) {
+        printf("Histogram of 0 to 63 is not exact.\n");
+        ok = false;
+    }
+
+    // 1 to 100000 once each, recorded as two halves and merged
+    Histogram low, high;
+    for (long long v = 1; v <= 100000; v++) (v <= 50000 ? low : high).Record(v);
+    low.Merge(high);
+    if (low.Count() != 100000 || low.Min() != 1 || low.Max() != 100000 || low.Mean() != 50000.5) {
+        printf("Merged histogram has count %lld, min %lld, max %lld, mean %.1f\n", low.Count(),
+               low.Min(), low.Max(), low.Mean());
+        ok = false;
+    }
+    ok &= Near("p50", low.Percentile(50), 50000);
+    ok &= Near("p99", low.Percentile(99), 99000);
+    ok &= Near("p99.9", low.Percentile(99.9), 99900);
+    ok &= Near("p100", low.Percentile(100), 100000);
+
+    // Precision holds across the whole range: the median of 99 values of v
+    // and one of 2v is v
+    for (long long v = 100; v < (1LL << 60); v = v * 3 / 2) {
+        Histogram wide;
+        for (int i = 0; i < 99; i++) wide.Record(v);
+        wide.Record(2 * v);
+        ok &= Near("median", wide.Percentile(50), v);
+    }
+    return ok;
+}
@@ -0,0 +1,46 @@
+/*
+ * DiskTest - latency histogram
+ *
+ * Log-bucketed histogram in the style of HdrHistogram: each power of two
+ * is split into 32 linear sub-buckets, so any recorded value is reproduced
+ * to within about 3% across the whole 64-bit range.  The buckets are a
+ * fixed array, so recording never allocates and costs a bit scan and an
+ * increment, cheap enough to do for every IO.
+ */
+
+#ifndef DISKTEST_HISTOGRAM_H
+#define DISKTEST_HISTOGRAM_H
+
+const int HISTOGRAM_SUB_BITS = 5;
+const int HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS;
+const int HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS;
+
+class Histogram {
+public:
+    Histogram();
+
+    void Reset();
+    void Record(long long value);
+    void Merge(const Histogram& other);
+
+    long long Count() const { return count; }
+    long long Min() const { return count ? minValue : 0; }
+    long long Max() const { return maxValue; }
+    double Mean() const { return count ? (double)sum / count : 0; }
+
+    // Value at or below which percent% of the recorded values fall
+    long long Percentile(double percent) const;
+
+private:
+    long long count;
+    long long sum;
+    long long minValue;
+    long long maxValue;
+    long long buckets[HISTOGRAM_BUCKETS];
+};
+
+// Check percentiles, merging and precision against values whose answers are
+// known.  Prints each failure; true if there were none.
+bool CheckHistogram();
+
+#endif // DISKTEST_HISTOGRAM_H
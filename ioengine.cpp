@@ -0,0 +1,54 @@
+/*
+ * DiskTest - I/O engine selection
+ */
+
+#include "ioengine.h"
+#include "platform.h"
+#include <stddef.h>
+
+int IOEngine::Submit(IORequest* const* requests, int count) {
+    for (int i = 0; i < count; i++) {
+        IORequest* request = requests[i];
+        if (request->write) {
+            request->result = Write(request->buffer, request->length, request->offset);
+        } else {
+            request->result = Read(request->buffer, request->length, request->offset);
+        }
+        completed.push_back(request);
+    }
+    return count;
+}
+
+int IOEngine::Reap(IORequest** done, int min, int max) {
+    int n = 0;
+    while (n < max && !completed.empty()) {
+        done[n++] = completed.back();
+        completed.pop_back();
+    }
+    return n;
+}
+
+IOEngine* CreateEngine(const char* name, int queueDepth) {
+    if (!name || !*name) {
+#ifdef _WIN32
+        return CreateWin32Engine();
+#else
+        return CreatePosixEngine();
+#endif
+    }
+
+#ifdef _WIN32
+    if (_stricmp(name, "win32") == 0) return CreateWin32Engine();
+#else
+    if (_stricmp(name, "posix") == 0 || _stricmp(name, "psync") == 0) {
+        return CreatePosixEngine();
+    }
+#endif
+    if (_stricmp(name, "mmap") == 0) return CreateMmapEngine();
+#ifdef __linux__
+    if (_stricmp(name, "io_uring") == 0 || _stricmp(name, "uring") == 0) {
+        return CreateUringEngine(queueDepth);
+    }
+#endif
+    return NULL;
+}
@@ -0,0 +1,127 @@
+/*
+ * DiskTest - I/O engine interface
+ *
+ * All test file access goes through an IOEngine so that the same workload
+ * code runs unchanged on every platform.  Transfers are positional (pread/
+ * pwrite semantics): there is no shared file pointer, so sequential tests
+ * simply advance the offset themselves.
+ *
+ * Engines may also queue requests asynchronously through Submit/Reap.  The
+ * synchronous engines inherit a default that completes each request as it
+ * is submitted, so callers can drive every engine the same way and simply
+ * get a queue depth of 1 from the synchronous ones.
+ */
+
+#ifndef DISKTEST_IOENGINE_H
+#define DISKTEST_IOENGINE_H
+
+#include <vector>
+
+// Open modes, combined with |
+const int IO_READ = 1;
+const int IO_WRITE = 2;
+const int IO_CREATE = 4; // Create the file, truncating any existing one
+const int IO_DIRECT = 8; // Bypass the OS cache; offsets, lengths and buffers
+                         // must be multiples of QueryBlockSize()
+const int IO_DSYNC = 16; // Each write is durable when it completes (O_DSYNC /
+                         // FILE_FLAG_WRITE_THROUGH)
+
+// Maximum queue depth accepted by the asynchronous engines
+const int MAX_QUEUE_DEPTH = 256;
+
+// A queued transfer.  result is filled in on completion.
+struct IORequest {
+    void* buffer;
+    long length;
+    long long offset;
+    bool write;
+    int bufferIndex; // Index into the registered buffers, or -1
+    long result;     // Bytes transferred, or -1 on error
+    long long issueTime; // For the caller's use; engines leave it alone
+};
+
+class IOEngine {
+public:
+    virtual ~IOEngine() {}
+
+    virtual const char* Name() const = 0;
+
+    virtual bool Open(const char* path, int mode) = 0;
+    virtual void Close() = 0;
+
+    // Size of the open file in bytes, or -1 on error
+    virtual long long Size() = 0;
+
+    // Allocate disk space for the first length bytes of the file, extending
+    // it if needed, so writes there need no further allocation.  Returns
+    // false if the file system cannot.
+    virtual bool Preallocate(long long length) = 0;
+
+    // Transfer length bytes at offset.  Return the number of bytes
+    // transferred, or -1 on error.
+    virtual long Read(void* buffer, long length, long long offset) = 0;
+    virtual long Write(const void* buffer, long length, long long offset) = 0;
+
+    // Make every write completed so far durable.  dataOnly skips metadata
+    // not needed to read the data back (fdatasync rather than fsync).
+    virtual bool Flush(bool dataOnly) = 0;
+
+    // False if writes cannot go beyond the end of the file, so it must be
+    // sized (with Preallocate) before a write test
+    virtual bool CanExtend() const { return true; }
+
+    // Number of requests that may be in flight at once
+    virtual int QueueDepth() const { return 1; }
+
+    // Pre-register the transfer buffers with the kernel, where supported.
+    // Requests then refer to them by bufferIndex.  Call after Open.
+    virtual bool RegisterBuffers(void* const* buffers, int count, long length) { return false; }
+
+    // Queue count requests; returns the number accepted, or -1 on error.
+    // Exactly the accepted ones, the first that many, will complete; the
+    // rest were not queued and their buffers are the caller's again.
+    virtual int Submit(IORequest* const* requests, int count);
+
+    // Wait until at least min requests have completed and return up to max
+    // of them in done.  Returns the number returned, or -1 on error.
+    virtual int Reap(IORequest** done, int min, int max);
+
+protected:
+    std::vector<IORequest*> completed;
+};
+
+// Create the named engine, or the platform's native synchronous engine when
+// name is NULL or empty.  queueDepth is a request to asynchronous engines;
+// check QueueDepth() for what was granted.  Returns NULL if the engine is
+// not available on this platform.
+IOEngine* CreateEngine(const char* name, int queueDepth = 1);
+
+IOEngine* CreateWin32Engine();
+IOEngine* CreatePosixEngine();
+IOEngine* CreateUringEngine(int queueDepth);
+IOEngine* CreateMmapEngine();
+
+// How the mmap engine maps files
+enum MapAdvice { MAP_ADVICE_NORMAL, MAP_ADVICE_SEQUENTIAL, MAP_ADVICE_RANDOM, MAP_ADVICE_WILLNEED };
+
+struct MapOptions {
+    int advice;    // MapAdvice, passed to madvise (not available on Windows)
+    bool populate; // Fault the whole file in when it is mapped
+    bool touch;    // Touch one byte per page instead of copying
+};
+
+void SetMapOptions(const MapOptions& options);
+
+#ifdef _WIN32
+// Size of an open file or device, for the Windows engines
+long long HandleSize(void* handle);
+#else
+// Preallocate for the POSIX engines (fallocate where available)
+bool PreallocateFd(int fd, long long length);
+// Size of an open file or block device, for the POSIX engines
+long long SizeFd(int fd);
+// Flush for the POSIX engines
+bool FlushFd(int fd, bool dataOnly);
+#endif
+
+#endif // DISKTEST_IOENGINE_H
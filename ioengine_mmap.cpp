@@ -0,0 +1,225 @@
+/*
+ * DiskTest - memory-mapped I/O engine
+ *
+ * Maps the whole file and serves each transfer with memcpy to or from the
+ * mapping, so the cost measured is page faults and the page cache rather
+ * than system calls: how a storage engine that mmaps its data files reads.
+ * In touch mode only one byte per page is read or written, which shows the
+ * fault cost on its own.  Writes cannot extend the file; RunWorkers sizes
+ * it first (see CanExtend).
+ */
+
+#include "ioengine.h"
+#include "platform.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+static MapOptions Options = {MAP_ADVICE_NORMAL, false, false};
+
+void SetMapOptions(const MapOptions& options) {
+    Options = options;
+}
+
+// Read one byte of each page of [p, p + length)
+static void TouchRead(const char* p, long length) {
+    long page = PageSize();
+    volatile char sink = 0;
+    for (long i = 0; i < length; i += page) sink = p[i];
+    (void)sink;
+}
+
+// Write one byte of each page of [p, p + length)
+static void TouchWrite(char* p, long length, char value) {
+    long page = PageSize();
+    for (long i = 0; i < length; i += page) ((volatile char*)p)[i] = value;
+}
+
+class MmapEngine : public IOEngine {
+public:
+#ifdef _WIN32
+    MmapEngine() : hFile(INVALID_HANDLE_VALUE), hMapping(NULL), base(NULL), mapped(0),
+                   writable(false) {}
+#else
+    MmapEngine() : fd(-1), base(NULL), mapped(0), writable(false) {}
+#endif
+    ~MmapEngine() { Close(); }
+
+    const char* Name() const { return "mmap"; }
+
+    bool CanExtend() const { return false; }
+
+    bool Open(const char* path, int mode) {
+        // A writable mapping needs read access too; IO_DIRECT and IO_DSYNC
+        // have no meaning
+        writable = (mode & IO_WRITE) != 0;
+#ifdef _WIN32
+        DWORD access = GENERIC_READ | (writable ? GENERIC_WRITE : 0);
+        DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+        DWORD disposition = (mode & IO_CREATE) ? CREATE_ALWAYS : OPEN_EXISTING;
+        hFile = CreateFileA(path, access, share, NULL, disposition, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return false;
+#else
+        int flags = writable ? O_RDWR : O_RDONLY;
+        if (mode & IO_CREATE) flags |= O_CREAT | O_TRUNC;
+        fd = open(path, flags, 0644);
+        if (fd < 0) return false;
+#endif
+        if (!Map()) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        Unmap();
+#ifdef _WIN32
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+#endif
+    }
+
+    long long Size() {
+#ifdef _WIN32
+        return HandleSize(hFile);
+#else
+        return SizeFd(fd);
+#endif
+    }
+
+    // Also the only way to grow the file, so falls back to just extending it
+    bool Preallocate(long long length) {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        size.QuadPart = length;
+        if (!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+            return false;
+        }
+#else
+        if (!PreallocateFd(fd, length) && Size() < length &&
+            ftruncate(fd, (off_t)length) != 0) {
+            return false;
+        }
+#endif
+        Unmap();
+        return Map();
+    }
+
+    long Read(void* buffer, long length, long long offset) {
+        if (offset < 0 || offset + length > mapped) return -1;
+        if (Options.touch) {
+            TouchRead(base + offset, length);
+        } else {
+            memcpy(buffer, base + offset, length);
+        }
+        return length;
+    }
+
+    long Write(const void* buffer, long length, long long offset) {
+        if (!writable || offset < 0 || offset + length > mapped) return -1;
+        if (Options.touch) {
+            TouchWrite(base + offset, length, *(const char*)buffer);
+        } else {
+            memcpy(base + offset, buffer, length);
+        }
+        return length;
+    }
+
+    // Dirty pages of the mapping go to the file first, then the file to disk
+    bool Flush(bool dataOnly) {
+#ifdef _WIN32
+        if (base && !FlushViewOfFile(base, 0)) return false;
+        return FlushFileBuffers(hFile) != 0;
+#else
+        if (base && msync(base, (size_t)mapped, MS_SYNC) != 0) return false;
+        return FlushFd(fd, dataOnly);
+#endif
+    }
+
+private:
+    // Map the file as it is now; an empty file is left unmapped
+    bool Map() {
+        long long size = Size();
+        if (size <= 0) return size == 0;
+#ifdef _WIN32
+        hMapping = CreateFileMappingA(hFile, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                      0, 0, NULL);
+        if (!hMapping) return false;
+        base = (char*)MapViewOfFile(hMapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+        if (!base) {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+            return false;
+        }
+        mapped = size;
+        // No madvise here; populating is done by touching every page
+        if (Options.populate) Populate();
+#else
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (Options.populate) flags |= MAP_POPULATE;
+#endif
+        void* p = mmap(NULL, (size_t)size, PROT_READ | (writable ? PROT_WRITE : 0), flags, fd, 0);
+        if (p == MAP_FAILED) return false;
+        base = (char*)p;
+        mapped = size;
+#ifndef MAP_POPULATE
+        if (Options.populate) Populate();
+#endif
+        static const int ADVICE[] = {POSIX_MADV_NORMAL, POSIX_MADV_SEQUENTIAL,
+                                     POSIX_MADV_RANDOM, POSIX_MADV_WILLNEED};
+        if (Options.advice != MAP_ADVICE_NORMAL) {
+            posix_madvise(base, (size_t)size, ADVICE[Options.advice]);
+        }
+#endif
+        return true;
+    }
+
+    // Fault in the whole mapping up front
+    void Populate() {
+        const long long CHUNK = 1 << 30;
+        for (long long offset = 0; offset < mapped; offset += CHUNK) {
+            long long n = mapped - offset < CHUNK ? mapped - offset : CHUNK;
+            TouchRead(base + offset, (long)n);
+        }
+    }
+
+    void Unmap() {
+        if (!base) return;
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+        CloseHandle(hMapping);
+        hMapping = NULL;
+#else
+        munmap(base, (size_t)mapped);
+#endif
+        base = NULL;
+        mapped = 0;
+    }
+
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#else
+    int fd;
+#endif
+    char* base;
+    long long mapped;
+    bool writable;
+};
+
+IOEngine* CreateMmapEngine() {
+    return new MmapEngine();
+}
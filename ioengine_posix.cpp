@@ -0,0 +1,150 @@
+/*
+ * DiskTest - native POSIX I/O engine
+ *
+ * Synchronous pread/pwrite on a file descriptor.
+ */
+
+#ifndef _WIN32
+
+#include "ioengine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#ifdef __APPLE__
+#include <sys/disk.h>
+#endif
+
+class PosixEngine : public IOEngine {
+public:
+    PosixEngine() : fd(-1) {}
+    ~PosixEngine() { Close(); }
+
+    const char* Name() const { return "posix"; }
+
+    bool Open(const char* path, int mode) {
+        int flags = 0;
+        if ((mode & IO_READ) && (mode & IO_WRITE)) {
+            flags = O_RDWR;
+        } else if (mode & IO_WRITE) {
+            flags = O_WRONLY;
+        } else {
+            flags = O_RDONLY;
+        }
+        if (mode & IO_CREATE) flags |= O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (mode & IO_DIRECT) flags |= O_DIRECT;
+#endif
+        if (mode & IO_DSYNC) flags |= O_DSYNC;
+
+        fd = open(path, flags, 0644);
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+        // macOS has no O_DIRECT; turning off caching is the equivalent
+        if (fd >= 0 && (mode & IO_DIRECT)) fcntl(fd, F_NOCACHE, 1);
+#endif
+        return fd >= 0;
+    }
+
+    void Close() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    long long Size() {
+        return SizeFd(fd);
+    }
+
+    bool Preallocate(long long length) {
+        return PreallocateFd(fd, length);
+    }
+
+    long Read(void* buffer, long length, long long offset) {
+        ssize_t n;
+        do {
+            n = pread(fd, buffer, length, offset);
+        } while (n < 0 && errno == EINTR);
+        return (long)n;
+    }
+
+    long Write(const void* buffer, long length, long long offset) {
+        ssize_t n;
+        do {
+            n = pwrite(fd, buffer, length, offset);
+        } while (n < 0 && errno == EINTR);
+        return (long)n;
+    }
+
+    bool Flush(bool dataOnly) {
+        return FlushFd(fd, dataOnly);
+    }
+
+private:
+    int fd;
+};
+
+bool PreallocateFd(int fd, long long length) {
+#ifdef __linux__
+    // Reserves real extents; unlike posix_fallocate it never falls back to
+    // writing zeros, which would take as long as the test itself
+    if (fallocate(fd, 0, 0, (off_t)length) == 0) return true;
+#elif defined(F_PREALLOCATE)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)length, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) == 0) {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size < length) return ftruncate(fd, (off_t)length) == 0;
+        return true;
+    }
+#endif
+    (void)fd;
+    (void)length;
+    return false;
+}
+
+long long SizeFd(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    // Block devices have no file size, but report their length
+#ifdef BLKGETSIZE64
+    unsigned long long bytes;
+    if (S_ISBLK(st.st_mode)) return ioctl(fd, BLKGETSIZE64, &bytes) == 0 ? (long long)bytes : -1;
+#elif defined(DKIOCGETBLOCKCOUNT)
+    uint32_t blockSize;
+    uint64_t blocks;
+    if (S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode)) {
+        if (ioctl(fd, DKIOCGETBLOCKSIZE, &blockSize) != 0 ||
+            ioctl(fd, DKIOCGETBLOCKCOUNT, &blocks) != 0) {
+            return -1;
+        }
+        return (long long)(blocks * blockSize);
+    }
+#endif
+    return st.st_size;
+}
+
+bool FlushFd(int fd, bool dataOnly) {
+    int result;
+#ifdef F_FULLFSYNC
+    // macOS fsync leaves the data in the drive's cache; F_FULLFSYNC flushes
+    // it, where the file system supports it
+    (void)dataOnly;
+    result = fcntl(fd, F_FULLFSYNC);
+    if (result != 0) result = fsync(fd);
+#else
+    do {
+        result = dataOnly ? fdatasync(fd) : fsync(fd);
+    } while (result != 0 && errno == EINTR);
+#endif
+    return result == 0;
+}
+
+IOEngine* CreatePosixEngine() {
+    return new PosixEngine();
+}
+
+#endif // !_WIN32
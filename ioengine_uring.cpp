@@ -0,0 +1,293 @@
+/*
+ * DiskTest - Linux io_uring I/O engine
+ *
+ * Asynchronous engine with a configurable queue depth, talking to the
+ * kernel directly through the io_uring system calls so no extra library is
+ * needed.  The test file and (when the caller registers them) the transfer
+ * buffers are registered with the ring, which saves the kernel a file table
+ * lookup and a page pinning pass on every request.
+ */
+
+#ifdef __linux__
+
+#include "ioengine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+static int UringSetup(unsigned entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int UringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int UringRegister(int ringFd, unsigned opcode, const void* arg, unsigned count) {
+    return (int)syscall(__NR_io_uring_register, ringFd, opcode, arg, count);
+}
+
+class UringEngine : public IOEngine {
+public:
+    UringEngine(int queueDepth)
+        : depth(queueDepth), fd(-1), ringFd(-1), fixedFile(false), fixedBuffers(false),
+          sqRing(NULL), cqRing(NULL), sqes(NULL), sqRingSize(0), cqRingSize(0), sqesSize(0) {
+        if (depth < 1) depth = 1;
+        if (depth > MAX_QUEUE_DEPTH) depth = MAX_QUEUE_DEPTH;
+    }
+    ~UringEngine() { Close(); }
+
+    const char* Name() const { return "io_uring"; }
+
+    bool Open(const char* path, int mode) {
+        int flags = 0;
+        if ((mode & IO_READ) && (mode & IO_WRITE)) {
+            flags = O_RDWR;
+        } else if (mode & IO_WRITE) {
+            flags = O_WRONLY;
+        } else {
+            flags = O_RDONLY;
+        }
+        if (mode & IO_CREATE) flags |= O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (mode & IO_DIRECT) flags |= O_DIRECT;
+#endif
+        if (mode & IO_DSYNC) flags |= O_DSYNC;
+
+        fd = open(path, flags, 0644);
+        if (fd < 0) return false;
+
+        if (!SetupRing()) {
+            Close();
+            return false;
+        }
+
+        // Registered files are an optimisation only; fall back to the plain fd
+        fixedFile = UringRegister(ringFd, IORING_REGISTER_FILES, &fd, 1) == 0;
+        return true;
+    }
+
+    void Close() {
+        if (ringFd >= 0) {
+            close(ringFd);
+            ringFd = -1;
+        }
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing) munmap(sqRing, sqRingSize);
+        sqes = NULL;
+        sqRing = cqRing = NULL;
+        completed.clear();
+        fixedFile = fixedBuffers = false;
+
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    long long Size() {
+        return SizeFd(fd);
+    }
+
+    bool Preallocate(long long length) {
+        return PreallocateFd(fd, length);
+    }
+
+    long Read(void* buffer, long length, long long offset) {
+        return Transfer(buffer, length, offset, false);
+    }
+
+    long Write(const void* buffer, long length, long long offset) {
+        return Transfer((void*)buffer, length, offset, true);
+    }
+
+    // Synchronous: it covers only writes already reaped, like fsync would
+    bool Flush(bool dataOnly) {
+        return FlushFd(fd, dataOnly);
+    }
+
+    int QueueDepth() const { return depth; }
+
+    bool RegisterBuffers(void* const* buffers, int count, long length) {
+        std::vector<struct iovec> iov(count);
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = buffers[i];
+            iov[i].iov_len = length;
+        }
+        // Fails harmlessly (e.g. RLIMIT_MEMLOCK too low); requests then use
+        // plain READ/WRITE instead of the _FIXED opcodes.
+        fixedBuffers = UringRegister(ringFd, IORING_REGISTER_BUFFERS, iov.data(), count) == 0;
+        return fixedBuffers;
+    }
+
+    int Submit(IORequest* const* requests, int count) {
+        unsigned tail = *sqTail;
+        for (int i = 0; i < count; i++) {
+            IORequest* request = requests[i];
+            unsigned index = tail & *sqMask;
+            struct io_uring_sqe* sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+
+            bool fixed = fixedBuffers && request->bufferIndex >= 0;
+            if (request->write) {
+                sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            } else {
+                sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            }
+            if (fixedFile) {
+                sqe->fd = 0;
+                sqe->flags = IOSQE_FIXED_FILE;
+            } else {
+                sqe->fd = fd;
+            }
+            sqe->addr = (uint64_t)(uintptr_t)request->buffer;
+            sqe->len = (uint32_t)request->length;
+            sqe->off = (uint64_t)request->offset;
+            if (fixed) sqe->buf_index = (uint16_t)request->bufferIndex;
+            sqe->user_data = (uint64_t)(uintptr_t)request;
+
+            sqArray[index] = index;
+            tail++;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+        // The SQEs are published now, so enter until the kernel has taken
+        // them all.  On a hard error withdraw the rest, which it has not
+        // seen (there is no SQ polling thread), so that the count returned
+        // is exactly what will complete.
+        int submitted = 0;
+        while (submitted < count) {
+            int n = UringEnter(ringFd, count - submitted, 0, 0);
+            if (n > 0) {
+                submitted += n;
+            } else if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            } else {
+                __atomic_store_n(sqTail, __atomic_load_n(sqHead, __ATOMIC_ACQUIRE),
+                                 __ATOMIC_RELEASE);
+                return submitted > 0 ? submitted : -1;
+            }
+        }
+        return submitted;
+    }
+
+    int Reap(IORequest** done, int min, int max) {
+        int n = 0;
+        // Completions Transfer picked up while waiting for its own
+        while (n < max && !completed.empty()) {
+            done[n++] = completed.back();
+            completed.pop_back();
+        }
+        for (;;) {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            while (head != tail && n < max) {
+                struct io_uring_cqe* cqe = &cqes[head & *cqMask];
+                IORequest* request = (IORequest*)(uintptr_t)cqe->user_data;
+                request->result = cqe->res < 0 ? -1 : cqe->res;
+                done[n++] = request;
+                head++;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+            if (n >= min) return n;
+            if (UringEnter(ringFd, 0, min - n, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                return -1;
+            }
+        }
+    }
+
+private:
+    bool SetupRing() {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = UringSetup(depth, &params);
+        if (ringFd < 0) return false;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+            cqRingSize = sqRingSize;
+        }
+
+        sqRing = Map(sqRingSize, IORING_OFF_SQ_RING);
+        if (!sqRing) return false;
+        cqRing = singleMap ? sqRing : Map(cqRingSize, IORING_OFF_CQ_RING);
+        if (!cqRing) return false;
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe*)Map(sqesSize, IORING_OFF_SQES);
+        if (!sqes) return false;
+
+        char* sq = (char*)sqRing;
+        sqHead = (unsigned*)(sq + params.sq_off.head);
+        sqTail = (unsigned*)(sq + params.sq_off.tail);
+        sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sqArray = (unsigned*)(sq + params.sq_off.array);
+
+        char* cq = (char*)cqRing;
+        cqHead = (unsigned*)(cq + params.cq_off.head);
+        cqTail = (unsigned*)(cq + params.cq_off.tail);
+        cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void* Map(size_t size, long long offset) {
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ringFd, offset);
+        return p == MAP_FAILED ? NULL : p;
+    }
+
+    long Transfer(void* buffer, long length, long long offset, bool write) {
+        IORequest request = {buffer, length, offset, write, -1, -1, 0};
+        IORequest* submit = &request;
+        if (Submit(&submit, 1) != 1) return -1;
+        // Other requests may be in flight; keep their completions for Reap
+        std::vector<IORequest*> others;
+        IORequest* done = NULL;
+        while (done != &request) {
+            if (Reap(&done, 1, 1) != 1) break;
+            if (done != &request) others.push_back(done);
+        }
+        completed.insert(completed.end(), others.begin(), others.end());
+        return done == &request ? request.result : -1;
+    }
+
+    int depth;
+    int fd;
+    int ringFd;
+    bool fixedFile;
+    bool fixedBuffers;
+
+    void* sqRing;
+    void* cqRing;
+    struct io_uring_sqe* sqes;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+IOEngine* CreateUringEngine(int queueDepth) {
+    return new UringEngine(queueDepth);
+}
+
+#endif // __linux__
@@ -0,0 +1,125 @@
+/*
+ * DiskTest - native Windows I/O engine
+ *
+ * Synchronous ReadFile/WriteFile with the offset passed in an OVERLAPPED
+ * structure, which on a non-overlapped handle behaves like pread/pwrite.
+ */
+
+#ifdef _WIN32
+
+#include "ioengine.h"
+#include "platform.h"
+#include <winioctl.h>
+
+// Enable SeManageVolumePrivilege for this process, once
+static bool EnableManageVolume() {
+    static int enabled = -1;
+    if (enabled >= 0) return enabled != 0;
+    enabled = 0;
+    HANDLE token;
+    if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        TOKEN_PRIVILEGES privileges;
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValueA(NULL, "SeManageVolumePrivilege",
+                                  &privileges.Privileges[0].Luid) &&
+            AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+            GetLastError() == ERROR_SUCCESS) {
+            enabled = 1;
+        }
+        CloseHandle(token);
+    }
+    return enabled != 0;
+}
+
+class Win32Engine : public IOEngine {
+public:
+    Win32Engine() : hFile(INVALID_HANDLE_VALUE) {}
+    ~Win32Engine() { Close(); }
+
+    const char* Name() const { return "win32"; }
+
+    bool Open(const char* path, int mode) {
+        DWORD access = 0;
+        if (mode & IO_READ) access |= GENERIC_READ;
+        if (mode & IO_WRITE) access |= GENERIC_WRITE;
+        // Worker threads may all open the same file
+        DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE;
+        DWORD disposition = (mode & IO_CREATE) ? CREATE_ALWAYS : OPEN_EXISTING;
+        DWORD attributes = FILE_ATTRIBUTE_NORMAL;
+        if (mode & IO_DIRECT) attributes |= FILE_FLAG_NO_BUFFERING;
+        if (mode & IO_DSYNC) attributes |= FILE_FLAG_WRITE_THROUGH;
+
+        hFile = CreateFileA(path, access, share, NULL, disposition, attributes, NULL);
+        return hFile != INVALID_HANDLE_VALUE;
+    }
+
+    void Close() {
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    long long Size() {
+        return HandleSize(hFile);
+    }
+
+    bool Preallocate(long long length) {
+        LARGE_INTEGER size;
+        size.QuadPart = length;
+        if (!SetFilePointerEx(hFile, size, NULL, FILE_BEGIN) || !SetEndOfFile(hFile)) {
+            return false;
+        }
+        // Without this NTFS zero-fills up to each write beyond the valid data
+        // length.  It needs SeManageVolumePrivilege (administrators), and
+        // exposes old disk contents, which is fine for a test file.
+        if (EnableManageVolume()) SetFileValidData(hFile, length);
+        return true;
+    }
+
+    long Read(void* buffer, long length, long long offset) {
+        OVERLAPPED ov = {0};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD bytesRead;
+        if (!::ReadFile(hFile, buffer, length, &bytesRead, &ov)) return -1;
+        return bytesRead;
+    }
+
+    long Write(const void* buffer, long length, long long offset) {
+        OVERLAPPED ov = {0};
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD bytesWritten;
+        if (!::WriteFile(hFile, buffer, length, &bytesWritten, &ov)) return -1;
+        return bytesWritten;
+    }
+
+    // Windows has no data-only flush
+    bool Flush(bool dataOnly) {
+        return FlushFileBuffers(hFile) != 0;
+    }
+
+private:
+    HANDLE hFile;
+};
+
+long long HandleSize(void* handle) {
+    LARGE_INTEGER size;
+    if (GetFileSizeEx((HANDLE)handle, &size)) return size.QuadPart;
+    // Devices have no file size, but report their length
+    GET_LENGTH_INFORMATION length;
+    DWORD bytes;
+    if (DeviceIoControl((HANDLE)handle, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length,
+                        sizeof(length), &bytes, NULL)) {
+        return length.Length.QuadPart;
+    }
+    return -1;
+}
+
+IOEngine* CreateWin32Engine() {
+    return new Win32Engine();
+}
+
+#endif // _WIN32
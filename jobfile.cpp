@@ -0,0 +1,208 @@
+/*
+ * DiskTest - job files
+ */
+
+#include "jobfile.h"
+#include "ioengine.h"
+#include "platform.h"
+#include "worker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static std::string Trim(const std::string& s) {
+    size_t first = 0, last = s.size();
+    while (first < last && isspace((unsigned char)s[first])) first++;
+    while (last > first && isspace((unsigned char)s[last - 1])) last--;
+    return s.substr(first, last - first);
+}
+
+// Bytes with an optional K, M, G or T suffix; false if not a number
+static bool ParseSize(const std::string& s, long long& value) {
+    char* end;
+    value = strtoll(s.c_str(), &end, 10);
+    if (end == s.c_str()) return false;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': value <<= 10; end++; break;
+    case 'M': value <<= 20; end++; break;
+    case 'G': value <<= 30; end++; break;
+    case 'T': value <<= 40; end++; break;
+    }
+    return *end == '\0';
+}
+
+static bool ParseInt(const std::string& s, int low, int high, int& value) {
+    char* end;
+    long n = strtol(s.c_str(), &end, 10);
+    if (end == s.c_str() || *end != '\0' || n < low || n > high) return false;
+    value = (int)n;
+    return true;
+}
+
+static bool ParseSeconds(const std::string& s, double& value) {
+    char* end;
+    value = strtod(s.c_str(), &end);
+    return end != s.c_str() && *end == '\0' && value >= 0;
+}
+
+static bool ParseBool(const std::string& s, bool& value) {
+    if (s == "1" || _stricmp(s.c_str(), "yes") == 0 || _stricmp(s.c_str(), "true") == 0) {
+        value = true;
+    } else if (s == "0" || _stricmp(s.c_str(), "no") == 0 || _stricmp(s.c_str(), "false") == 0) {
+        value = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Apply one key=value to job; returns an error message, or NULL
+static const char* SetKey(Job& job, const std::string& key, const std::string& value) {
+    long long size;
+    const char* k = key.c_str();
+    if (_stricmp(k, "file") == 0) {
+        job.file = value;
+    } else if (_stricmp(k, "engine") == 0) {
+        job.engine = value;
+    } else if (_stricmp(k, "bs") == 0) {
+        if (!ParseSize(value, size) || size < 512 || size > MAX_TRANSFER || size % 512 != 0) {
+            return "bs must be a multiple of 512 up to 4M";
+        }
+        job.blockSize = (int)size;
+    } else if (_stricmp(k, "read") == 0) {
+        if (!ParseInt(value, 0, 100, job.readPercent)) return "read must be 0 to 100";
+    } else if (_stricmp(k, "access") == 0) {
+        if (_stricmp(value.c_str(), "random") == 0) {
+            job.random = true;
+        } else if (_stricmp(value.c_str(), "sequential") == 0) {
+            job.random = false;
+        } else {
+            return "access must be random or sequential";
+        }
+    } else if (_stricmp(k, "qd") == 0) {
+        if (!ParseInt(value, 1, MAX_QUEUE_DEPTH, job.queueDepth)) return "qd out of range";
+    } else if (_stricmp(k, "threads") == 0) {
+        if (!ParseInt(value, 1, MAX_THREADS, job.threads)) return "threads out of range";
+    } else if (_stricmp(k, "offset") == 0) {
+        if (!ParseSize(value, size) || size < 0 || size % 512 != 0) {
+            return "offset must be a multiple of 512";
+        }
+        job.offset = size;
+    } else if (_stricmp(k, "size") == 0) {
+        if (!ParseSize(value, size) || size < 65536) return "size must be 64K or more";
+        job.size = size;
+    } else if (_stricmp(k, "ios") == 0) {
+        if (!ParseSize(value, size) || size < 1) return "ios must be 1 or more";
+        job.ops = size;
+    } else if (_stricmp(k, "runtime") == 0) {
+        if (!ParseSeconds(value, job.runtime)) return "runtime must be seconds";
+    } else if (_stricmp(k, "ramp") == 0) {
+        if (!ParseSeconds(value, job.ramp)) return "ramp must be seconds";
+    } else if (_stricmp(k, "direct") == 0) {
+        if (!ParseBool(value, job.direct)) return "direct must be 0 or 1";
+    } else if (_stricmp(k, "permute") == 0) {
+        if (!ParseBool(value, job.permute)) return "permute must be 0 or 1";
+    } else if (_stricmp(k, "dist") == 0) {
+        if (!ParseDistribution(value.c_str(), job.distribution)) {
+            return "dist must be uniform, zipf:theta, hot:h:a or jitter:j";
+        }
+    } else if (_stricmp(k, "rate") == 0) {
+        if (value == "0") {
+            job.rate = job.rateBytes = 0;
+        } else if (!ParseRate(value.c_str(), job.rate, job.rateBytes)) {
+            return "rate must be IOs per second, or bytes per second with K, M or G";
+        }
+    } else if (_stricmp(k, "sync") == 0) {
+        if (!ParseInt(value, 0, 1000000, job.syncEvery)) return "sync must be 0 to 1000000";
+    } else if (_stricmp(k, "datasync") == 0) {
+        if (!ParseBool(value, job.syncData)) return "datasync must be 0 or 1";
+    } else if (_stricmp(k, "dsync") == 0) {
+        if (!ParseBool(value, job.dsync)) return "dsync must be 0 or 1";
+    } else if (_stricmp(k, "groupcommit") == 0) {
+        if (!ParseBool(value, job.groupCommit)) return "groupcommit must be 0 or 1";
+    } else if (_stricmp(k, "seed") == 0) {
+        char* end;
+        job.seed = strtoull(value.c_str(), &end, 0);
+        if (end == value.c_str() || *end != '\0') return "seed must be a number";
+    } else {
+        return "unknown setting";
+    }
+    return NULL;
+}
+
+bool LoadJobFile(const char* path, const Job& defaults, std::vector<Job>& jobs) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("Cannot open job file %s\n", path);
+        return false;
+    }
+
+    Job global = defaults;
+    Job* current = NULL;
+    bool inGlobal = false;
+    char line[512];
+    int lineNumber = 0;
+    bool ok = true;
+    jobs.clear();
+
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        std::string text = line;
+        size_t comment = text.find_first_of(";#");
+        if (comment != std::string::npos) text.erase(comment);
+        text = Trim(text);
+        if (text.empty()) continue;
+
+        if (text[0] == '[') {
+            if (text[text.size() - 1] != ']') {
+                printf("%s line %d: missing ]\n", path, lineNumber);
+                ok = false;
+                break;
+            }
+            std::string name = Trim(text.substr(1, text.size() - 2));
+            inGlobal = _stricmp(name.c_str(), "global") == 0;
+            if (!inGlobal) {
+                jobs.push_back(global);
+                jobs.back().name = name;
+            }
+            current = inGlobal ? &global : &jobs.back();
+            continue;
+        }
+
+        size_t equals = text.find('=');
+        if (equals == std::string::npos || !current) {
+            printf("%s line %d: expected [job] or key=value\n", path, lineNumber);
+            ok = false;
+            break;
+        }
+        std::string key = Trim(text.substr(0, equals));
+        std::string value = Trim(text.substr(equals + 1));
+        const char* error = SetKey(*current, key, value);
+        if (error) {
+            printf("%s line %d: %s: %s\n", path, lineNumber, key.c_str(), error);
+            ok = false;
+        }
+    }
+    fclose(f);
+
+    if (ok && jobs.empty()) {
+        printf("%s contains no jobs\n", path);
+        ok = false;
+    }
+    for (size_t i = 0; ok && i < jobs.size(); i++) {
+        if (jobs[i].size < jobs[i].blockSize * (long long)jobs[i].threads) {
+            printf("%s: job %s is too small for its block size and threads\n",
+                   path, jobs[i].name.c_str());
+            ok = false;
+        } else if (jobs[i].permute && jobs[i].distribution.kind != DIST_UNIFORM) {
+            printf("%s: job %s: permute visits every block evenly, and cannot be used with dist\n",
+                   path, jobs[i].name.c_str());
+            ok = false;
+        } else if ((jobs[i].syncData || jobs[i].groupCommit) && jobs[i].syncEvery == 0) {
+            printf("%s: job %s: datasync and groupcommit need sync\n", path, jobs[i].name.c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,72 @@
+/*
+ * DiskTest - job files
+ *
+ * A job file describes a mix of workloads in INI form, one section per job:
+ *
+ *   [global]            ; settings every later job starts from
+ *   file=data.fil
+ *   size=256M
+ *
+ *   [db-read]
+ *   bs=8K
+ *   read=70             ; percent of IOs that are reads, in steps of 10
+ *   access=random       ; or sequential
+ *   qd=16
+ *   threads=4
+ *   runtime=30
+ *   rate=2000           ; IOs per second (or 50M for bytes per second)
+ *   dist=zipf:0.99      ; or uniform, hot:10:90, jitter:16
+ *
+ *   [wal]
+ *   access=sequential
+ *   read=0
+ *   bs=4K
+ *   threads=8
+ *   sync=1              ; flush after every write (0, the default, never)
+ *   datasync=1          ; with fdatasync rather than fsync
+ *   groupcommit=1       ; the threads share flushes
+ *   dsync=0             ; or open with O_DSYNC instead
+ *
+ * The file is parsed once into a list of Jobs, which the caller turns into
+ * Workloads and runs in order with RunWorkers.
+ */
+
+#ifndef DISKTEST_JOBFILE_H
+#define DISKTEST_JOBFILE_H
+
+#include "distribution.h"
+#include <string>
+#include <vector>
+
+struct Job {
+    std::string name;
+    std::string file;     // Empty for the default test file
+    std::string engine;   // Empty for the command line engine
+    int blockSize;
+    int readPercent;
+    bool random;
+    int queueDepth;
+    int threads;
+    long long offset;     // Start of the region the job covers
+    long long size;       // Bytes of region
+    long long ops;        // Random IOs per thread, if not timed
+    double runtime;       // Seconds, 0 to run ops / one pass
+    double ramp;
+    bool direct;
+    bool permute;
+    DistributionSpec distribution;
+    unsigned long long seed;
+    double rate;          // IOs per second, 0 for flat out
+    double rateBytes;     // Or bytes per second
+    int syncEvery;        // Flush after every syncEvery writes, 0 for never
+    bool syncData;
+    bool dsync;
+    bool groupCommit;
+};
+
+// Parse path into jobs, each starting from defaults (as overridden by any
+// [global] section).  Reports the first error with its line number and
+// returns false.
+bool LoadJobFile(const char* path, const Job& defaults, std::vector<Job>& jobs);
+
+#endif // DISKTEST_JOBFILE_H
@@ -0,0 +1,165 @@
+/*
+ * DiskTest - metadata and small-file benchmark
+ */
+
+#include "metadata.h"
+#include "ioengine.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+const char* const META_OP_NAMES[META_OPS] = {"create", "stat", "read", "rename", "delete"};
+
+// Directories at the deepest level
+static int Leaves(const MetaWorkload& w) {
+    int leaves = 1;
+    for (int level = 0; level < w.depth; level++) leaves *= w.fanout;
+    return leaves;
+}
+
+// Directory number index of the given level (0 is the root)
+static std::string DirectoryPath(const MetaWorkload& w, int level, int index) {
+    std::string path = w.root;
+    // Digits of index in base fanout, most significant first
+    std::vector<int> digits(level);
+    for (int i = level - 1; i >= 0; i--) {
+        digits[i] = index % w.fanout;
+        index /= w.fanout;
+    }
+    char name[16];
+    for (int i = 0; i < level; i++) {
+        snprintf(name, sizeof(name), "%cd%02x", PATH_SEPARATOR, digits[i]);
+        path += name;
+    }
+    return path;
+}
+
+// File number index, under its original name or its name after rename
+static std::string FilePath(const MetaWorkload& w, int index, bool renamed) {
+    std::string path = DirectoryPath(w, w.depth, index % Leaves(w));
+    char name[24];
+    snprintf(name, sizeof(name), "%c%c%08d", PATH_SEPARATOR, renamed ? 'r' : 'f', index);
+    return path + name;
+}
+
+bool BuildMetadataTree(const MetaWorkload& w) {
+    if (!MakeDir(w.root.c_str())) {
+        printf("Cannot create %s; it must not already exist.\n", w.root.c_str());
+        return false;
+    }
+    int count = 1;
+    for (int level = 1; level <= w.depth; level++) {
+        count *= w.fanout;
+        for (int i = 0; i < count; i++) {
+            std::string path = DirectoryPath(w, level, i);
+            if (!MakeDir(path.c_str())) {
+                printf("Cannot create %s\n", path.c_str());
+                RemoveMetadataTree(w, false);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void RemoveMetadataTree(const MetaWorkload& w, bool leftovers) {
+    for (int i = 0; i < w.files && leftovers; i++) {
+        remove(FilePath(w, i, false).c_str());
+        remove(FilePath(w, i, true).c_str());
+    }
+    int count = Leaves(w);
+    for (int level = w.depth; level >= 0; level--) {
+        for (int i = 0; i < count; i++) {
+            RemoveDir(DirectoryPath(w, level, i).c_str());
+        }
+        count /= w.fanout;
+    }
+}
+
+// Thread index's share of the files: every threads'th from index
+static void MetaWorker(const MetaWorkload& w, MetaOp op, int index, WorkerStats& stats,
+                       std::atomic<int>& ready, std::atomic<bool>& go, long long& start) {
+    stats.cpu = -1;
+    stats.ops = stats.bytes = stats.errors = stats.flushes = 0;
+    stats.elapsed = 0;
+    stats.readLatency.Reset();
+    stats.writeLatency.Reset();
+    stats.commitLatency.Reset();
+    std::vector<char> buffer(w.fileSize > 0 ? w.fileSize : 1, (char)(0x5A + index));
+    std::unique_ptr<IOEngine> file(CreateEngine(NULL));
+    // Names are worked out before timing starts
+    std::vector<std::string> paths, renamed;
+    for (int i = index; i < w.files; i += w.threads) {
+        paths.push_back(FilePath(w, i, op == META_DELETE));
+        if (op == META_RENAME) renamed.push_back(FilePath(w, i, true));
+    }
+    Histogram& latency = op == META_STAT || op == META_READ ? stats.readLatency
+                                                            : stats.writeLatency;
+
+    ready++;
+    while (!go) std::this_thread::yield();
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        const char* path = paths[i].c_str();
+        long long size = 0;
+        long long begin = ClockNanos();
+        bool ok = true;
+        switch (op) {
+        case META_CREATE:
+            ok = file->Open(path, IO_WRITE | IO_CREATE);
+            if (ok && w.fileSize > 0) ok = file->Write(buffer.data(), w.fileSize, 0) == w.fileSize;
+            if (ok) size = w.fileSize;
+            file->Close();
+            break;
+        case META_STAT:
+            ok = StatPath(path, size);
+            size = 0;
+            break;
+        case META_READ:
+            ok = file->Open(path, IO_READ);
+            if (ok && w.fileSize > 0) ok = file->Read(buffer.data(), w.fileSize, 0) == w.fileSize;
+            if (ok) size = w.fileSize;
+            file->Close();
+            break;
+        case META_RENAME:
+            ok = rename(path, renamed[i].c_str()) == 0;
+            break;
+        default:
+            ok = remove(path) == 0;
+            break;
+        }
+        latency.Record(ClockNanos() - begin);
+        stats.ops++;
+        stats.bytes += size;
+        if (!ok) stats.errors++;
+    }
+    stats.elapsed = (ClockNanos() - start) / 1e9;
+}
+
+void RunMetadataPhase(const MetaWorkload& w, MetaOp op, MetaPhase& phase) {
+    phase.stats.assign(w.threads, WorkerStats());
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    long long start = 0;
+
+    std::vector<std::thread> pool;
+    for (int t = 0; t < w.threads; t++) {
+        pool.push_back(std::thread(MetaWorker, std::cref(w), op, t, std::ref(phase.stats[t]),
+                                   std::ref(ready), std::ref(go), std::ref(start)));
+    }
+    while (ready < w.threads) std::this_thread::yield();
+    start = ClockNanos();
+    go = true;
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+
+    phase.elapsed = 0;
+    for (int t = 0; t < w.threads; t++) {
+        if (phase.stats[t].elapsed > phase.elapsed) phase.elapsed = phase.stats[t].elapsed;
+    }
+    if (phase.elapsed <= 0) phase.elapsed = 0.01; // Prevent division by zero
+}
@@ -0,0 +1,60 @@
+/*
+ * DiskTest - metadata and small-file benchmark
+ *
+ * The other tests all work inside one large, preallocated file, which is
+ * the easy case for a file system.  This one measures what many small files
+ * cost: it builds a tree of directories (fanout subdirectories per level,
+ * depth levels deep), then runs each operation over every file in turn:
+ *
+ *   create   open a new file, write fileSize bytes, close
+ *   stat     look up the file's size by name
+ *   read     open, read fileSize bytes, close
+ *   rename   give the file a new name in the same directory
+ *   delete   remove it
+ *
+ * Files are spread round-robin over the deepest directories and dealt out
+ * to the threads the same way, so threads work in the same directories at
+ * once as they would in a real application.  Each operation is timed
+ * individually into the thread's WorkerStats: reads and stats as read
+ * latency, the rest as write latency.  Building and removing the tree are
+ * not timed.
+ */
+
+#ifndef DISKTEST_METADATA_H
+#define DISKTEST_METADATA_H
+
+#include "worker.h"
+#include <string>
+#include <vector>
+
+enum MetaOp { META_CREATE, META_STAT, META_READ, META_RENAME, META_DELETE, META_OPS };
+
+extern const char* const META_OP_NAMES[META_OPS];
+
+struct MetaWorkload {
+    std::string root;     // Directory the tree is built in, which must not exist
+    int files;
+    int fileSize;         // Bytes each create writes and each read reads
+    int fanout;           // Subdirectories of each directory
+    int depth;            // Levels of subdirectories; the files go in the deepest
+    int threads;
+};
+
+struct MetaPhase {
+    double elapsed;       // Seconds until the last thread finished
+    std::vector<WorkerStats> stats; // Per thread
+};
+
+// Most directories the tree may have at its deepest level
+const int MAX_META_LEAVES = 65536;
+
+// Create the directory tree (untimed); false, with a message and nothing
+// left behind, on failure
+bool BuildMetadataTree(const MetaWorkload& w);
+// Run one operation over every file on w.threads threads
+void RunMetadataPhase(const MetaWorkload& w, MetaOp op, MetaPhase& phase);
+// Remove the tree, and with leftovers any files an interrupted or failed
+// run left behind
+void RemoveMetadataTree(const MetaWorkload& w, bool leftovers);
+
+#endif // DISKTEST_METADATA_H
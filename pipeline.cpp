@@ -0,0 +1,243 @@
+/*
+ * DiskTest - pipelined pattern writes and read-back verification
+ */
+
+#include "pipeline.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+
+// Buffers beyond the queue depth, so the verifier can work on blocks that
+// have been read while the next reads are still in flight
+const int VERIFY_SLACK = 4;
+
+PatternPipeline::PatternPipeline()
+    : depth(1), ringSize(0), inflight(0), blockBytes(0), writeFailed(false), readFailed(false),
+      unique(false), generation(0), seed(0), firstBlock(0), endBlock(0), nextRead(0), nextDone(0),
+      stop(false) {
+}
+
+PatternPipeline::~PatternPipeline() {
+    Stop();
+}
+
+bool PatternPipeline::Open(const char* path, const char* engine, int queueDepth, bool direct,
+                           const void* pattern, long bytes) {
+    unique = false;
+    if (!OpenFile(path, engine, queueDepth, direct, bytes, 1)) return false;
+    memcpy(pool.Slot(ringSize), pattern, blockBytes);
+    return true;
+}
+
+bool PatternPipeline::OpenUnique(const char* path, const char* engine, int queueDepth,
+                                 bool direct, long bytes, unsigned long long pass,
+                                 unsigned long long runSeed) {
+    unique = true;
+    generation = pass;
+    seed = runSeed;
+    return OpenFile(path, engine, queueDepth, direct, bytes, MAX_QUEUE_DEPTH);
+}
+
+// Open the file and set up the buffers: writeBuffers of them shared out
+// among the write requests (capped at the engine's queue depth)
+bool PatternPipeline::OpenFile(const char* path, const char* engine, int queueDepth,
+                               bool direct, long bytes, int writeBuffers) {
+    file.reset(CreateEngine(engine, queueDepth));
+    int mode = IO_READ | IO_WRITE;
+    if (direct) mode |= IO_DIRECT;
+    // The pattern writes grow the file as they go
+    if (!file || !file->CanExtend() || !file->Open(path, mode)) {
+        file.reset();
+        return false;
+    }
+
+    depth = file->QueueDepth();
+    ringSize = depth + VERIFY_SLACK;
+    blockBytes = bytes;
+    if (writeBuffers > depth) writeBuffers = depth;
+    int total = ringSize + writeBuffers;
+    if (!pool.Allocate(total, blockBytes, PageSize())) {
+        file.reset();
+        return false;
+    }
+    std::vector<void*> buffers(total);
+    for (int i = 0; i < total; i++) buffers[i] = pool.Slot(i);
+    bool registered = file->RegisterBuffers(buffers.data(), total, (long)pool.SlotSize());
+
+    slots.reset(new Slot[ringSize]);
+    for (int i = 0; i < ringSize; i++) {
+        slots[i].state = SLOT_FREE;
+        slots[i].request.buffer = pool.Slot(i);
+        slots[i].request.length = blockBytes;
+        slots[i].request.write = false;
+        slots[i].request.bufferIndex = registered ? i : -1;
+    }
+    writes.resize(depth);
+    idleWrites.clear();
+    for (int i = 0; i < depth; i++) {
+        int index = ringSize + i % writeBuffers;
+        writes[i].buffer = pool.Slot(index);
+        writes[i].length = blockBytes;
+        writes[i].write = true;
+        writes[i].bufferIndex = registered ? index : -1;
+        idleWrites.push_back(&writes[i]);
+    }
+    batch.resize(depth);
+    inflight = 0;
+    writeFailed = false;
+    return true;
+}
+
+// Collect at least min completions, marking reads as ready to verify
+bool PatternPipeline::Reap(int min) {
+    if (min > inflight) return false; // Would wait forever
+    int done = file->Reap(batch.data(), min, depth);
+    if (done < 0) return false;
+    for (int i = 0; i < done; i++) {
+        IORequest* request = batch[i];
+        if (request->write) {
+            if (request->result != blockBytes) writeFailed = true;
+            idleWrites.push_back(request);
+        } else {
+            int index = (int)(((char*)request->buffer - (char*)pool.Slot(0)) / pool.SlotSize());
+            slots[index].state.store(SLOT_READ, std::memory_order_release);
+        }
+    }
+    inflight -= done;
+    return true;
+}
+
+bool PatternPipeline::Write(long long offset) {
+    if (idleWrites.empty() && !Reap(1)) return false;
+    IORequest* request = idleWrites.back();
+    idleWrites.pop_back();
+    request->offset = offset;
+    if (unique) FillBlock(request->buffer, blockBytes, offset, generation, seed);
+    IORequest* submit = request;
+    if (file->Submit(&submit, 1) != 1) {
+        idleWrites.push_back(request);
+        writeFailed = true;
+        return false;
+    }
+    inflight++;
+    return !writeFailed;
+}
+
+bool PatternPipeline::FinishWrites() {
+    while (inflight > 0) {
+        if (!Reap(1)) return false;
+    }
+    return !writeFailed;
+}
+
+void PatternPipeline::StartVerify(long long first, long long end) {
+    firstBlock = first;
+    endBlock = end;
+    nextRead = nextDone = first;
+    readFailed = false;
+    stop = false;
+    verifier = std::thread(&PatternPipeline::VerifyThread, this);
+}
+
+// Queue reads into every free slot, as far as the queue depth allows
+void PatternPipeline::IssueReads() {
+    int count = 0;
+    while (!readFailed && inflight + count < depth && nextRead < endBlock) {
+        Slot& slot = slots[nextRead % ringSize];
+        if (slot.state.load(std::memory_order_acquire) != SLOT_FREE) break;
+        slot.state.store(SLOT_READING, std::memory_order_relaxed);
+        slot.request.offset = nextRead * blockBytes;
+        batch[count++] = &slot.request;
+        nextRead++;
+    }
+    if (count > 0) {
+        int submitted = file->Submit(batch.data(), count);
+        if (submitted < 0) submitted = 0;
+        inflight += submitted;
+        if (submitted < count) {
+            // The engine is failing: the blocks not accepted are never read,
+            // and verifying stops once those in flight are done
+            readFailed = true;
+            nextRead = batch[submitted]->offset / blockBytes;
+            for (int i = submitted; i < count; i++) {
+                Slot& slot = slots[(batch[i]->offset / blockBytes) % ringSize];
+                slot.state.store(SLOT_FREE, std::memory_order_release);
+            }
+        }
+    }
+}
+
+// Wait for the next block in order to be verified
+PatternPipeline::Slot* PatternPipeline::NextSlot() {
+    if (!file || nextDone >= endBlock) return NULL;
+    if (readFailed && nextDone >= nextRead) return NULL;
+    Slot& slot = slots[nextDone % ringSize];
+    for (;;) {
+        IssueReads();
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state == SLOT_VERIFIED) break;
+        if (state == SLOT_READING) {
+            // Our block is still on its way from the disk
+            if (!Reap(1)) return NULL;
+        } else {
+            // Read, and waiting on the verifier; pick up other completions meanwhile
+            if (inflight > 0 && !Reap(0)) return NULL;
+            std::this_thread::yield();
+        }
+    }
+    nextDone++;
+    return &slot;
+}
+
+bool PatternPipeline::NextVerified(CompareResult& result) {
+    Slot* slot = NextSlot();
+    if (!slot) return false;
+    result = slot->result;
+    slot->state.store(SLOT_FREE, std::memory_order_release);
+    return true;
+}
+
+bool PatternPipeline::NextChecked(BlockCheck& check) {
+    Slot* slot = NextSlot();
+    if (!slot) return false;
+    check = slot->check;
+    slot->state.store(SLOT_FREE, std::memory_order_release);
+    return true;
+}
+
+void PatternPipeline::VerifyThread() {
+    const void* pattern = pool.Slot(ringSize);
+    for (long long block = firstBlock; block < endBlock; block++) {
+        Slot& slot = slots[block % ringSize];
+        while (slot.state.load(std::memory_order_acquire) != SLOT_READ) {
+            if (stop) return;
+            std::this_thread::yield();
+        }
+        if (unique) {
+            if (slot.request.result == blockBytes) {
+                slot.check = CheckBlock(slot.request.buffer, blockBytes, slot.request.offset,
+                                        generation, seed);
+            } else {
+                slot.check.status = BLOCK_CORRUPT;
+                slot.check.foundOffset = -1;
+                slot.check.foundGeneration = 0;
+            }
+        } else if (slot.request.result == blockBytes) {
+            slot.result = CompareBlocks(pattern, slot.request.buffer, blockBytes);
+        } else {
+            slot.result.firstMismatch = 0;
+            slot.result.badWords = blockBytes / 2;
+        }
+        slot.state.store(SLOT_VERIFIED, std::memory_order_release);
+    }
+}
+
+void PatternPipeline::Stop() {
+    stop = true;
+    if (verifier.joinable()) verifier.join();
+    // Buffers must not be freed under a request the kernel still owns
+    while (file && inflight > 0 && Reap(1)) {
+    }
+    if (file) file->Close();
+    file.reset();
+}
@@ -0,0 +1,105 @@
+/*
+ * DiskTest - pipelined pattern writes and read-back verification
+ *
+ * The plain pattern test does one thing at a time: write a block, or read
+ * a block and compare it, so the disk waits for the CPU and the CPU for the
+ * disk.  PatternPipeline keeps up to a queue depth of writes in flight, and
+ * when reading back keeps a ring of buffers moving: reads for later blocks
+ * are outstanding while a separate thread verifies earlier ones.  Results
+ * are still handed back strictly in block order, so the caller's progress
+ * display works exactly as before.
+ *
+ * OpenUnique switches to the unique-data format instead of a fixed pattern:
+ * each write is filled with its own header and payload, and each read is
+ * checked with CheckBlock rather than compared.
+ */
+
+#ifndef DISKTEST_PIPELINE_H
+#define DISKTEST_PIPELINE_H
+
+#include "bufferpool.h"
+#include "ioengine.h"
+#include "verify.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class PatternPipeline {
+public:
+    PatternPipeline();
+    ~PatternPipeline();
+
+    // Open path for reading and writing with the named engine at up to
+    // queueDepth requests in flight.  pattern is the blockBytes block every
+    // write stores and every read is checked against.
+    bool Open(const char* path, const char* engine, int queueDepth, bool direct,
+              const void* pattern, long blockBytes);
+    // As Open, but writing and checking FillBlock blocks for this generation
+    bool OpenUnique(const char* path, const char* engine, int queueDepth, bool direct,
+                    long blockBytes, unsigned long long generation, unsigned long long seed);
+
+    // Queue a write of the pattern at offset; false on a write error, or if
+    // it could not be queued
+    bool Write(long long offset);
+    // Wait for all queued writes; false if any failed
+    bool FinishWrites();
+
+    // Start reading back blocks first to end - 1 and verifying them
+    void StartVerify(long long first, long long end);
+    // The next block's comparison, in order.  A failed read counts every
+    // word of the block as bad.  False once every block has been returned,
+    // or early if the engine stopped taking reads.
+    bool NextVerified(CompareResult& result);
+    // The same for unique-data blocks; a failed read counts as corrupt
+    bool NextChecked(BlockCheck& check);
+
+    // Abandon any reads or verification in progress and close the file
+    void Stop();
+
+private:
+    PatternPipeline(const PatternPipeline&);
+    PatternPipeline& operator=(const PatternPipeline&);
+
+    enum SlotState { SLOT_FREE, SLOT_READING, SLOT_READ, SLOT_VERIFIED };
+
+    struct Slot {
+        std::atomic<int> state;
+        IORequest request;
+        CompareResult result;
+        BlockCheck check;
+    };
+
+    bool OpenFile(const char* path, const char* engine, int queueDepth, bool direct,
+                  long bytes, int writeBuffers);
+    Slot* NextSlot();
+    void IssueReads();
+    bool Reap(int min);
+    void VerifyThread();
+
+    std::unique_ptr<IOEngine> file;
+    BufferPool pool;              // ringSize read buffers, then the pattern
+                                  // or one write buffer per request
+    std::unique_ptr<Slot[]> slots;
+    std::vector<IORequest> writes;
+    std::vector<IORequest*> idleWrites;
+    std::vector<IORequest*> batch;
+    int depth;
+    int ringSize;
+    int inflight;
+    long blockBytes;
+    bool writeFailed;
+    bool readFailed;              // Submit refused reads; nextRead is never read
+    bool unique;
+    unsigned long long generation;
+    unsigned long long seed;
+
+    long long firstBlock;
+    long long endBlock;
+    long long nextRead;
+    long long nextDone;
+    std::thread verifier;
+    std::atomic<bool> stop;
+};
+
+#endif // DISKTEST_PIPELINE_H
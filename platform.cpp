@@ -0,0 +1,530 @@
+/*
+ * DiskTest - platform support
+ */
+
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <conio.h>
+#include <io.h>
+#include <malloc.h>
+#include <winioctl.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sysmacros.h>
+#endif
+#ifdef __APPLE__
+#include <sys/disk.h>
+#endif
+#endif
+
+int CpuCount() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 0 ? (int)count : 1;
+}
+
+void WaitUntil(long long due) {
+    long long wait = due - ClockNanos();
+    if (wait > 2000000) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait - 1000000));
+    } else if (wait > 0) {
+        std::this_thread::yield();
+    }
+}
+
+#ifdef _WIN32
+
+static LARGE_INTEGER frequency;
+
+bool InitClock() {
+    return QueryPerformanceFrequency(&frequency) != 0;
+}
+
+long long ClockNanos() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    // Split to avoid overflowing when scaling the tick count
+    long long seconds = now.QuadPart / frequency.QuadPart;
+    long long remainder = now.QuadPart % frequency.QuadPart;
+    return seconds * 1000000000LL + remainder * 1000000000LL / frequency.QuadPart;
+}
+
+bool KeyPressed() {
+    return _kbhit() != 0;
+}
+
+int ReadKey() {
+    return _getch();
+}
+
+bool PinCurrentThread(int cpu) {
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8)) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+long long QueryFreeSpace(const char* path) {
+    ULARGE_INTEGER freeBytesAvailable;
+    if (GetDiskFreeSpaceExA(path, &freeBytesAvailable, NULL, NULL)) {
+        return (long long)freeBytesAvailable.QuadPart;
+    }
+    return 0;
+}
+
+bool IsDirectory(const char* path) {
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool MakeDir(const char* path) {
+    return CreateDirectoryA(path, NULL) != 0;
+}
+
+bool RemoveDir(const char* path) {
+    return RemoveDirectoryA(path) != 0;
+}
+
+bool StatPath(const char* path, long long& size) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data)) return false;
+    size = ((long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    return true;
+}
+
+// \\.\PhysicalDriveN, \\.\X: and the like
+static bool IsDevicePath(const char* path) {
+    return strncmp(path, "\\\\.\\", 4) == 0;
+}
+
+bool QueryDeviceGeometry(const char* path, DeviceGeometry& geometry) {
+    if (!IsDevicePath(path)) return false;
+    HANDLE hDevice = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                 OPEN_EXISTING, 0, NULL);
+    if (hDevice == INVALID_HANDLE_VALUE) return false;
+
+    DWORD bytes;
+    GET_LENGTH_INFORMATION length;
+    bool ok = DeviceIoControl(hDevice, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0, &length,
+                              sizeof(length), &bytes, NULL) != 0;
+    if (ok) {
+        geometry.size = length.Length.QuadPart;
+        geometry.logicalBlock = geometry.physicalBlock = 512;
+        STORAGE_PROPERTY_QUERY query = {};
+        query.PropertyId = StorageAccessAlignmentProperty;
+        query.QueryType = PropertyStandardQuery;
+        STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment = {};
+        DISK_GEOMETRY disk;
+        if (DeviceIoControl(hDevice, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                            &alignment, sizeof(alignment), &bytes, NULL)) {
+            geometry.logicalBlock = (long)alignment.BytesPerLogicalSector;
+            geometry.physicalBlock = (long)alignment.BytesPerPhysicalSector;
+        } else if (DeviceIoControl(hDevice, IOCTL_DISK_GET_DRIVE_GEOMETRY, NULL, 0, &disk,
+                                   sizeof(disk), &bytes, NULL)) {
+            geometry.logicalBlock = geometry.physicalBlock = (long)disk.BytesPerSector;
+        }
+    }
+    CloseHandle(hDevice);
+    return ok;
+}
+
+long QueryBlockSize(const char* path) {
+    DeviceGeometry geometry;
+    if (QueryDeviceGeometry(path, geometry)) return geometry.logicalBlock;
+    char root[MAX_PATH];
+    DWORD sectorsPerCluster, bytesPerSector, freeClusters, totalClusters;
+    if (GetVolumePathNameA(path, root, sizeof(root)) &&
+        GetDiskFreeSpaceA(root, &sectorsPerCluster, &bytesPerSector, &freeClusters, &totalClusters)) {
+        return (long)bytesPerSector;
+    }
+    return 512;
+}
+
+void QueryHostInfo(char* host, size_t hostSize, char* os, size_t osSize) {
+    DWORD length = (DWORD)hostSize;
+    if (!GetComputerNameA(host, &length)) host[0] = '\0';
+
+    // GetVersionEx reports whatever the manifest claims; ntdll does not
+    typedef LONG (WINAPI* RtlGetVersionProc)(OSVERSIONINFOW*);
+    RtlGetVersionProc getVersion =
+        (RtlGetVersionProc)GetProcAddress(GetModuleHandleA("ntdll.dll"), "RtlGetVersion");
+    OSVERSIONINFOW info = {0};
+    info.dwOSVersionInfoSize = sizeof(info);
+    if (getVersion && getVersion(&info) == 0) {
+        snprintf(os, osSize, "Windows %lu.%lu.%lu", info.dwMajorVersion,
+                 info.dwMinorVersion, info.dwBuildNumber);
+    } else {
+        snprintf(os, osSize, "Windows");
+    }
+}
+
+void QueryDeviceInfo(const char* path, char* model, size_t modelSize,
+                     char* firmware, size_t firmwareSize) {
+    model[0] = firmware[0] = '\0';
+    char root[MAX_PATH], volume[MAX_PATH];
+    if (IsDevicePath(path)) {
+        snprintf(volume, sizeof(volume), "%s", path);
+    } else if (GetVolumePathNameA(path, root, sizeof(root)) && strlen(root) >= 2 &&
+               root[1] == ':') {
+        snprintf(volume, sizeof(volume), "\\\\.\\%c:", root[0]);
+    } else {
+        return;
+    }
+    HANDLE hVolume = CreateFileA(volume, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                                 OPEN_EXISTING, 0, NULL);
+    if (hVolume == INVALID_HANDLE_VALUE) return;
+
+    STORAGE_PROPERTY_QUERY query = {};
+    query.PropertyId = StorageDeviceProperty;
+    query.QueryType = PropertyStandardQuery;
+    char buffer[1024] = {0};
+    DWORD bytes;
+    if (DeviceIoControl(hVolume, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                        buffer, sizeof(buffer) - 1, &bytes, NULL)) {
+        STORAGE_DEVICE_DESCRIPTOR* desc = (STORAGE_DEVICE_DESCRIPTOR*)buffer;
+        if (desc->ProductIdOffset) snprintf(model, modelSize, "%s", buffer + desc->ProductIdOffset);
+        if (desc->ProductRevisionOffset) {
+            snprintf(firmware, firmwareSize, "%s", buffer + desc->ProductRevisionOffset);
+        }
+    }
+    CloseHandle(hVolume);
+}
+
+long PageSize() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (long)info.dwPageSize;
+}
+
+void QueryPageFaults(long long& minor, long long& major) {
+    // Windows counts soft and hard faults together
+    PROCESS_MEMORY_COUNTERS counters;
+    minor = major = 0;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        minor = counters.PageFaultCount;
+    }
+}
+
+void* AlignedAlloc(size_t size, size_t alignment) {
+    return _aligned_malloc(size, alignment);
+}
+
+void AlignedFree(void* p) {
+    _aligned_free(p);
+}
+
+bool IsConsole() {
+    return _isatty(_fileno(stdout)) != 0;
+}
+
+FILE* SeparateStdout() {
+    fflush(stdout);
+    int report = _dup(_fileno(stdout));
+    if (report < 0 || _dup2(_fileno(stderr), _fileno(stdout)) != 0) return NULL;
+    return _fdopen(report, "w");
+}
+
+#else
+
+bool InitClock() {
+    struct timespec ts;
+    return clock_gettime(CLOCK_MONOTONIC, &ts) == 0;
+}
+
+long long ClockNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Switch the terminal to unbuffered, no-echo input for the duration of a
+// keyboard poll, so single keypresses are seen without waiting for Enter.
+static bool RawTerminal(struct termios& saved) {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0) {
+        return false;
+    }
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    return true;
+}
+
+bool KeyPressed() {
+    struct termios saved;
+    if (!RawTerminal(saved)) return false;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    struct timeval tv = {0, 0};
+    int ready = select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv);
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return ready > 0;
+}
+
+int ReadKey() {
+    struct termios saved;
+    if (!RawTerminal(saved)) return -1;
+
+    fflush(stdout);
+    unsigned char ch = 0;
+    ssize_t n = read(STDIN_FILENO, &ch, 1);
+
+    tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    return n == 1 ? ch : -1;
+}
+
+bool PinCurrentThread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+long long QueryFreeSpace(const char* path) {
+    struct statvfs vfs;
+    if (statvfs(path, &vfs) == 0) {
+        return (long long)vfs.f_bavail * vfs.f_frsize;
+    }
+    return 0;
+}
+
+bool IsDirectory(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+bool MakeDir(const char* path) {
+    return mkdir(path, 0755) == 0;
+}
+
+bool RemoveDir(const char* path) {
+    return rmdir(path) == 0;
+}
+
+bool StatPath(const char* path, long long& size) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    size = (long long)st.st_size;
+    return true;
+}
+
+// Read a single number from a sysfs attribute
+static long ReadSysfsNumber(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    long value = 0;
+    if (fscanf(f, "%ld", &value) != 1) value = 0;
+    fclose(f);
+    return value;
+}
+
+bool QueryDeviceGeometry(const char* path, DeviceGeometry& geometry) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !(S_ISBLK(st.st_mode) || S_ISCHR(st.st_mode))) return false;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = false;
+#ifdef __linux__
+    unsigned long long size;
+    int logical = 0;
+    unsigned int physical = 0;
+    if (S_ISBLK(st.st_mode) && ioctl(fd, BLKGETSIZE64, &size) == 0 &&
+        ioctl(fd, BLKSSZGET, &logical) == 0) {
+        geometry.size = (long long)size;
+        geometry.logicalBlock = logical;
+        geometry.physicalBlock = ioctl(fd, BLKPBSZGET, &physical) == 0 ? (long)physical : logical;
+        ok = true;
+    }
+#elif defined(__APPLE__)
+    // Both /dev/diskN and the raw /dev/rdiskN
+    uint32_t logical = 0, physical = 0;
+    uint64_t count = 0;
+    if (ioctl(fd, DKIOCGETBLOCKSIZE, &logical) == 0 &&
+        ioctl(fd, DKIOCGETBLOCKCOUNT, &count) == 0) {
+        geometry.size = (long long)(count * logical);
+        geometry.logicalBlock = (long)logical;
+        geometry.physicalBlock = ioctl(fd, DKIOCGETPHYSICALBLOCKSIZE, &physical) == 0
+                                     ? (long)physical : (long)logical;
+        ok = true;
+    }
+#endif
+    close(fd);
+    return ok;
+}
+
+long QueryBlockSize(const char* path) {
+#if defined(__linux__) && defined(STATX_DIOALIGN)
+    // Kernels from 6.1 report exactly what the filesystem needs
+    struct statx sx;
+    if (statx(AT_FDCWD, path, 0, STATX_DIOALIGN, &sx) == 0 &&
+        (sx.stx_mask & STATX_DIOALIGN) && sx.stx_dio_offset_align > 0) {
+        return (long)sx.stx_dio_offset_align;
+    }
+#endif
+#ifdef __linux__
+    // Otherwise the logical block size of the underlying device, whose queue
+    // attributes live on the whole disk rather than the partition
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+        unsigned int devMajor = major(dev);
+        unsigned int devMinor = minor(dev);
+        char attr[128];
+        snprintf(attr, sizeof(attr), "/sys/dev/block/%u:%u/queue/logical_block_size",
+                 devMajor, devMinor);
+        long size = ReadSysfsNumber(attr);
+        if (size <= 0) {
+            snprintf(attr, sizeof(attr), "/sys/dev/block/%u:%u/../queue/logical_block_size",
+                     devMajor, devMinor);
+            size = ReadSysfsNumber(attr);
+        }
+        if (size > 0) return size;
+    }
+#endif
+    return 512;
+}
+
+void QueryHostInfo(char* host, size_t hostSize, char* os, size_t osSize) {
+    if (gethostname(host, hostSize) != 0) host[0] = '\0';
+    host[hostSize - 1] = '\0';
+    struct utsname name;
+    if (uname(&name) == 0) {
+        snprintf(os, osSize, "%s %s %s", name.sysname, name.release, name.machine);
+    } else {
+        snprintf(os, osSize, "%s", PLATFORM_NAME);
+    }
+}
+
+#ifdef __linux__
+// Read a one-line sysfs attribute with trailing padding removed
+static bool ReadSysfsString(const char* path, char* value, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    bool ok = fgets(value, (int)size, f) != NULL;
+    fclose(f);
+    if (!ok) return false;
+    size_t length = strlen(value);
+    while (length > 0 && (value[length - 1] == '\n' || value[length - 1] == ' ')) {
+        value[--length] = '\0';
+    }
+    return length > 0;
+}
+#endif
+
+void QueryDeviceInfo(const char* path, char* model, size_t modelSize,
+                     char* firmware, size_t firmwareSize) {
+    model[0] = firmware[0] = '\0';
+#ifdef __linux__
+    // As for the block size, a partition's device attributes are on its disk
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+    dev_t dev = S_ISBLK(st.st_mode) ? st.st_rdev : st.st_dev;
+    const char* dirs[2] = {"device", "../device"};
+    for (int i = 0; i < 2 && !model[0]; i++) {
+        char attr[128];
+        snprintf(attr, sizeof(attr), "/sys/dev/block/%u:%u/%s/model",
+                 major(dev), minor(dev), dirs[i]);
+        if (!ReadSysfsString(attr, model, modelSize)) continue;
+        // NVMe calls it firmware_rev, SCSI and SATA rev
+        snprintf(attr, sizeof(attr), "/sys/dev/block/%u:%u/%s/firmware_rev",
+                 major(dev), minor(dev), dirs[i]);
+        if (ReadSysfsString(attr, firmware, firmwareSize)) break;
+        snprintf(attr, sizeof(attr), "/sys/dev/block/%u:%u/%s/rev",
+                 major(dev), minor(dev), dirs[i]);
+        ReadSysfsString(attr, firmware, firmwareSize);
+    }
+#else
+    (void)path;
+    (void)modelSize;
+    (void)firmwareSize;
+#endif
+}
+
+long PageSize() {
+    return sysconf(_SC_PAGESIZE);
+}
+
+void QueryPageFaults(long long& minor, long long& major) {
+    struct rusage usage;
+    minor = major = 0;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+    }
+}
+
+void* AlignedAlloc(size_t size, size_t alignment) {
+    void* p = NULL;
+    if (posix_memalign(&p, alignment, size) != 0) return NULL;
+    return p;
+}
+
+void AlignedFree(void* p) {
+    free(p);
+}
+
+bool IsConsole() {
+    return isatty(fileno(stdout)) != 0;
+}
+
+FILE* SeparateStdout() {
+    fflush(stdout);
+    int report = dup(fileno(stdout));
+    if (report < 0 || dup2(fileno(stderr), fileno(stdout)) < 0) return NULL;
+    return fdopen(report, "w");
+}
+
+#endif
+
+ProgressLine::ProgressLine() : shown(0) {
+}
+
+ProgressLine::~ProgressLine() {
+    Clear();
+}
+
+void ProgressLine::Show(const char* text) {
+    // Back up, write the new text, and blank whatever is left of the old
+    int length = (int)strlen(text);
+    for (int i = 0; i < shown; i++) putchar('\b');
+    fputs(text, stdout);
+    for (int i = length; i < shown; i++) putchar(' ');
+    for (int i = length; i < shown; i++) putchar('\b');
+    fflush(stdout);
+    shown = length;
+}
+
+void ProgressLine::Clear() {
+    if (shown == 0) return;
+    for (int i = 0; i < shown; i++) putchar('\b');
+    for (int i = 0; i < shown; i++) putchar(' ');
+    for (int i = 0; i < shown; i++) putchar('\b');
+    fflush(stdout);
+    shown = 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * DiskTest - platform support
+ *
+ * Everything the tests need from the OS other than file I/O (which goes
+ * through IOEngine, see ioengine.h): the high-resolution clock, console
+ * progress display, keyboard polling, thread pinning, aligned memory, page
+ * fault counts and free space, block size and host/device description queries.
+ */
+
+#ifndef DISKTEST_PLATFORM_H
+#define DISKTEST_PLATFORM_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <strings.h>
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+#endif
+
+#ifdef _WIN32
+const char* const PLATFORM_NAME = "Windows";
+#elif defined(__linux__)
+const char* const PLATFORM_NAME = "Linux";
+#else
+const char* const PLATFORM_NAME = "POSIX";
+#endif
+
+#ifdef _WIN32
+const char PATH_SEPARATOR = '\\';
+#else
+const char PATH_SEPARATOR = '/';
+#endif
+
+// High-resolution clock
+bool InitClock();
+long long ClockNanos();
+// Wait towards ClockNanos() time due: sleeps while it is far off and yields
+// when it is close, so call it in a loop until due has passed
+void WaitUntil(long long due);
+
+// Keyboard polling (always false / -1 when stdin is not a console)
+bool KeyPressed();
+int ReadKey();
+
+// Processor count, and pinning of the calling thread to one processor
+int CpuCount();
+bool PinCurrentThread(int cpu);
+
+// Free bytes available to the caller on the volume holding path
+long long QueryFreeSpace(const char* path);
+bool IsDirectory(const char* path);
+
+// Directory creation and removal (of an empty directory), and the size of a
+// file by name, for the metadata test; false on failure
+bool MakeDir(const char* path);
+bool RemoveDir(const char* path);
+bool StatPath(const char* path, long long& size);
+
+// Alignment unbuffered (direct) I/O to path needs, for offsets, transfer
+// sizes and buffers: the logical block size of the device holding it.
+long QueryBlockSize(const char* path);
+
+// Size and block sizes of the block device path names (/dev/sdb,
+// \\.\PhysicalDrive1...).  False if path is not a device.
+struct DeviceGeometry {
+    long long size;       // Bytes
+    long logicalBlock;    // Smallest addressable unit
+    long physicalBlock;   // Unit the device writes internally
+};
+bool QueryDeviceGeometry(const char* path, DeviceGeometry& geometry);
+
+// Host name and OS name/release, and the model and firmware revision of
+// the device holding path, for result reports.  Empty strings if unknown.
+void QueryHostInfo(char* host, size_t hostSize, char* os, size_t osSize);
+void QueryDeviceInfo(const char* path, char* model, size_t modelSize,
+                     char* firmware, size_t firmwareSize);
+
+// Memory page size, and page-aligned (or more) allocation
+long PageSize();
+// Page faults taken by this process so far: minor ones (the page was in
+// memory) and major ones (it had to be read from disk)
+void QueryPageFaults(long long& minor, long long& major);
+void* AlignedAlloc(size_t size, size_t alignment);
+void AlignedFree(void* p);
+
+// True if standard output is a console, where progress can be redrawn
+bool IsConsole();
+
+// A stream on the real standard output, after which anything else printed
+// to stdout goes to standard error instead; NULL on failure
+FILE* SeparateStdout();
+
+// Progress text after whatever is already on the cursor's line, redrawn in
+// place by backing over it, and erased when cleared or destroyed so the
+// line can be finished as if it had never been there.
+class ProgressLine {
+public:
+    ProgressLine();
+    ~ProgressLine();
+    void Show(const char* text);
+    void Clear();
+
+private:
+    int shown;            // Characters on screen
+};
+
+#endif // DISKTEST_PLATFORM_H
@@ -0,0 +1,110 @@
+/*
+ * DiskTest - offset generators
+ *
+ * Random is xoshiro256**: 64-bit output, a 2^256 - 1 period and a few
+ * nanoseconds per number, so it never limits IOPS and reaches every offset
+ * in even a multi-terabyte file (rand() has as little as 15 bits).  It is
+ * seeded through SplitMix64, so one seed= value gives every thread its own
+ * repeatable stream.
+ *
+ * Permutation visits each of n blocks exactly once per pass in a scrambled
+ * order: a full-period LCG modulo the next power of two, passed through a
+ * bijective mixer, skipping values of n or more.
+ */
+
+#ifndef DISKTEST_RANDOM_H
+#define DISKTEST_RANDOM_H
+
+// Expand a seed into well-mixed 64-bit values
+inline unsigned long long SplitMix64(unsigned long long& state) {
+    unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+class Random {
+public:
+    explicit Random(unsigned long long seed = 0) { Seed(seed); }
+
+    void Seed(unsigned long long seed) {
+        for (int i = 0; i < 4; i++) s[i] = SplitMix64(seed);
+    }
+
+    unsigned long long Next() {
+        unsigned long long result = Rotl(s[1] * 5, 7) * 9;
+        unsigned long long t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = Rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, n), without modulo bias
+    unsigned long long Below(unsigned long long n) {
+        if (n <= 1) return 0;
+        // Values below 2^64 mod n would make the low results more likely
+        unsigned long long threshold = (0 - n) % n;
+        unsigned long long x;
+        do {
+            x = Next();
+        } while (x < threshold);
+        return x % n;
+    }
+
+private:
+    static unsigned long long Rotl(unsigned long long x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    unsigned long long s[4];
+};
+
+class Permutation {
+public:
+    Permutation() : n(0), mask(0), bits(1), state(0), increment(1) {}
+
+    void Init(unsigned long long count, Random& random) {
+        n = count > 0 ? count : 1;
+        bits = 1;
+        while (bits < 64 && (1ULL << bits) < n) bits++;
+        mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+        state = random.Next() & mask;
+        increment = (random.Next() | 1) & mask; // Odd, for a full period
+        if (increment == 0) increment = 1;
+    }
+
+    // Next block index; every one in [0, n) comes up once per n calls
+    unsigned long long Next() {
+        unsigned long long value;
+        do {
+            // Multiplier is 1 mod 4, so with an odd increment the LCG
+            // cycles through all 2^bits states
+            state = (state * 6364136223846793005ULL + increment) & mask;
+            value = Mix(state);
+        } while (value >= n);
+        return value;
+    }
+
+private:
+    // A bijection on [0, 2^bits): xorshifts and an odd multiply, all
+    // invertible modulo a power of two
+    unsigned long long Mix(unsigned long long x) const {
+        int shift = bits / 2 + 1;
+        x ^= x >> shift;
+        x = (x * 0xD6E8FEB86659FD93ULL) & mask;
+        x ^= x >> shift;
+        return x;
+    }
+
+    unsigned long long n;
+    unsigned long long mask;
+    int bits;
+    unsigned long long state;
+    unsigned long long increment;
+};
+
+#endif // DISKTEST_RANDOM_H
@@ -0,0 +1,181 @@
+/*
+ * DiskTest - machine-readable results
+ */
+
+#include "report.h"
+#include "ioengine.h"
+#include <memory>
+
+// Latency columns, in microseconds: count, min, mean, percentiles, max
+static const char* const LATENCY_NAMES[8] = {
+    "count", "min", "mean", "p50", "p90", "p99", "p99_9", "max"
+};
+
+static void LatencyValues(const Histogram& h, double values[8]) {
+    values[0] = (double)h.Count();
+    values[1] = h.Min() / 1e3;
+    values[2] = h.Mean() / 1e3;
+    values[3] = h.Percentile(50) / 1e3;
+    values[4] = h.Percentile(90) / 1e3;
+    values[5] = h.Percentile(99) / 1e3;
+    values[6] = h.Percentile(99.9) / 1e3;
+    values[7] = h.Max() / 1e3;
+}
+
+// The rate limit of a workload as IOs per second, 0 if it ran flat out
+static double RateIops(const Workload& w) {
+    if (w.rate > 0) return w.rate;
+    return w.rateBytes > 0 ? w.rateBytes / w.blockSize : 0;
+}
+
+static void JsonString(FILE* f, const std::string& s) {
+    fputc('"', f);
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void CsvString(FILE* f, const std::string& s) {
+    fputc('"', f);
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"') fputc('"', f);
+        fputc(s[i], f);
+    }
+    fputc('"', f);
+}
+
+static void JsonLatency(FILE* f, const char* name, const Histogram& h) {
+    double values[8];
+    LatencyValues(h, values);
+    fprintf(f, "      \"%s\": {", name);
+    for (int i = 0; i < 8; i++) {
+        fprintf(f, i == 0 ? "\"%s\": %.0f" : ", \"%s\": %.3f", LATENCY_NAMES[i], values[i]);
+    }
+    fprintf(f, "}");
+}
+
+void Report::AddInfo(const char* key, const std::string& value) {
+    info.push_back(std::make_pair(std::string(key), value));
+}
+
+void Report::Add(const char* name, const Workload& w, const std::vector<WorkerStats>& stats,
+                 const RunResult& run) {
+    TestResult r;
+    r.name = name;
+    r.config = w;
+    r.config.path = r.config.engine = NULL;
+    r.config.buffers = NULL;
+    r.path = w.path;
+    std::unique_ptr<IOEngine> probe(CreateEngine(w.engine, w.queueDepth));
+    r.engine = probe ? probe->Name() : "";
+    r.queueDepth = probe ? probe->QueueDepth() : 1;
+    r.config.threads = stats.empty() ? w.threads : (int)stats.size();
+    r.total = MergeStats(stats);
+    r.run = run;
+    results.push_back(r);
+}
+
+void Report::WriteJson(FILE* f) const {
+    fprintf(f, "{\n  \"info\": {");
+    for (size_t i = 0; i < info.size(); i++) {
+        fprintf(f, "%s\n    ", i == 0 ? "" : ",");
+        JsonString(f, info[i].first);
+        fprintf(f, ": ");
+        JsonString(f, info[i].second);
+    }
+    fprintf(f, "\n  },\n  \"tests\": [");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const TestResult& r = results[i];
+        const Workload& w = r.config;
+        fprintf(f, "%s\n    {\n      \"name\": ", i == 0 ? "" : ",");
+        JsonString(f, r.name);
+        fprintf(f, ",\n      \"config\": {\"file\": ");
+        JsonString(f, r.path);
+        fprintf(f, ", \"engine\": ");
+        JsonString(f, r.engine);
+        fprintf(f, ", \"queue_depth\": %d, \"block_size\": %d, \"read_percent\": %d, "
+                   "\"access\": \"%s\", \"threads\": %d, \"file_per_thread\": %s, "
+                   "\"direct\": %s, \"offset\": %lld, \"size\": %lld, \"ios\": %lld, "
+                   "\"runtime\": %.3f, \"ramp\": %.3f, \"permute\": %s, \"seed\": %llu, "
+                   "\"rate_iops\": %.1f, \"sync_every\": %d, \"data_sync\": %s, "
+                   "\"dsync\": %s, \"group_commit\": %s, \"distribution\": \"%s\"},\n",
+                r.queueDepth, w.blockSize, w.readPercent, w.random ? "random" : "sequential",
+                w.threads, w.filePerThread ? "true" : "false", w.direct ? "true" : "false",
+                w.offset, w.size, w.random ? w.ops : 0, w.runtime, w.ramp,
+                w.permute ? "true" : "false", w.seed, RateIops(w), w.syncEvery,
+                w.syncData ? "true" : "false", w.dsync ? "true" : "false",
+                w.groupCommit ? "true" : "false", DistributionName(w.distribution).c_str());
+        fprintf(f, "      \"bytes\": %lld, \"ops\": %lld, \"errors\": %lld, \"elapsed\": %.6f,\n",
+                r.total.bytes, r.total.ops, r.total.errors, r.run.elapsed);
+        fprintf(f, "      \"throughput_kbs\": %.2f, \"iops\": %.1f, \"steady_after\": %.3f,\n",
+                r.total.bytes / 1024.0 / r.run.elapsed, r.total.ops / r.run.elapsed,
+                r.run.steadyAfter);
+        fprintf(f, "      \"minor_faults\": %lld, \"major_faults\": %lld, \"flushes\": %lld,\n",
+                r.run.minorFaults, r.run.majorFaults, r.total.flushes);
+        JsonLatency(f, "read_latency_us", r.total.readLatency);
+        fprintf(f, ",\n");
+        JsonLatency(f, "write_latency_us", r.total.writeLatency);
+        fprintf(f, ",\n");
+        JsonLatency(f, "commit_latency_us", r.total.commitLatency);
+        fprintf(f, "\n    }");
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+void Report::WriteCsv(FILE* f) const {
+    for (size_t i = 0; i < info.size(); i++) {
+        fprintf(f, "%s,", info[i].first.c_str());
+    }
+    fprintf(f, "name,file,engine,queue_depth,block_size,read_percent,access,threads,"
+               "file_per_thread,direct,offset,size,ios,runtime,ramp,permute,seed,rate_iops,"
+               "sync_every,data_sync,dsync,group_commit,distribution,bytes,ops,errors,elapsed,"
+               "throughput_kbs,iops,steady_after,minor_faults,major_faults,flushes");
+    const char* kinds[3] = {"read", "write", "commit"};
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < 8; i++) {
+            fprintf(f, ",%s_%s%s", kinds[k], LATENCY_NAMES[i], i == 0 ? "" : "_us");
+        }
+    }
+    fprintf(f, "\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const TestResult& r = results[i];
+        const Workload& w = r.config;
+        for (size_t j = 0; j < info.size(); j++) {
+            CsvString(f, info[j].second);
+            fputc(',', f);
+        }
+        CsvString(f, r.name);
+        fputc(',', f);
+        CsvString(f, r.path);
+        fprintf(f, ",%s,%d,%d,%d,%s,%d,%d,%d,%lld,%lld,%lld,%.3f,%.3f,%d,%llu,%.1f",
+                r.engine.c_str(), r.queueDepth, w.blockSize, w.readPercent,
+                w.random ? "random" : "sequential", w.threads, w.filePerThread ? 1 : 0,
+                w.direct ? 1 : 0, w.offset, w.size, w.random ? w.ops : 0, w.runtime, w.ramp,
+                w.permute ? 1 : 0, w.seed, RateIops(w));
+        fprintf(f, ",%d,%d,%d,%d,%s", w.syncEvery, w.syncData ? 1 : 0, w.dsync ? 1 : 0,
+                w.groupCommit ? 1 : 0, DistributionName(w.distribution).c_str());
+        fprintf(f, ",%lld,%lld,%lld,%.6f,%.2f,%.1f,%.3f,%lld,%lld,%lld",
+                r.total.bytes, r.total.ops, r.total.errors, r.run.elapsed,
+                r.total.bytes / 1024.0 / r.run.elapsed, r.total.ops / r.run.elapsed,
+                r.run.steadyAfter, r.run.minorFaults, r.run.majorFaults, r.total.flushes);
+        const Histogram* latency[3] = {&r.total.readLatency, &r.total.writeLatency,
+                                       &r.total.commitLatency};
+        for (int k = 0; k < 3; k++) {
+            double values[8];
+            LatencyValues(*latency[k], values);
+            fprintf(f, ",%.0f", values[0]);
+            for (int v = 1; v < 8; v++) fprintf(f, ",%.3f", values[v]);
+        }
+        fprintf(f, "\n");
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * DiskTest - machine-readable results
+ *
+ * Collects each test's configuration and results as it finishes, together
+ * with host and device details, and writes them out as a JSON document or
+ * as CSV.  CSV has one row per test with the host and device details
+ * repeated on every row, so files from many runs can simply be concatenated
+ * (after dropping their header lines) and compared.
+ */
+
+#ifndef DISKTEST_REPORT_H
+#define DISKTEST_REPORT_H
+
+#include "worker.h"
+#include <stdio.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct TestResult {
+    std::string name;
+    Workload config;
+    std::string path;     // Copies of config.path and the engine's name, as the
+    std::string engine;   // originals may not outlive the test
+    int queueDepth;       // As the engine actually ran it
+    WorkerStats total;
+    RunResult run;
+};
+
+class Report {
+public:
+    // Host/device detail shown once in JSON and as leading CSV columns
+    void AddInfo(const char* key, const std::string& value);
+
+    // Record the last test: its workload and per-thread results
+    void Add(const char* name, const Workload& w, const std::vector<WorkerStats>& stats,
+             const RunResult& run);
+
+    void WriteJson(FILE* f) const;
+    void WriteCsv(FILE* f) const;
+
+private:
+    std::vector<std::pair<std::string, std::string> > info;
+    std::vector<TestResult> results;
+};
+
+#endif // DISKTEST_REPORT_H
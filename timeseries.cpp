@@ -0,0 +1,47 @@
+/*
+ * DiskTest - per-interval results
+ */
+
+#include "timeseries.h"
+
+IntervalRing::IntervalRing() : first(0), count(0), dropped(0) {
+}
+
+void IntervalRing::Reset(size_t capacity) {
+    samples.assign(capacity > 0 ? capacity : 1, IntervalSample());
+    first = count = 0;
+    dropped = 0;
+}
+
+void IntervalRing::Add(const IntervalSample& sample) {
+    if (samples.empty()) return;
+    if (count < samples.size()) {
+        samples[(first + count) % samples.size()] = sample;
+        count++;
+    } else {
+        samples[first] = sample;
+        first = (first + 1) % samples.size();
+        dropped++;
+    }
+}
+
+void WriteIntervalHeader(FILE* f) {
+    fprintf(f, "test,thread,time,seconds,ops,bytes,iops,throughput_kbs,"
+               "mean_us,p50_us,p99_us,p99_9_us,max_us\n");
+}
+
+void WriteIntervals(FILE* f, const char* test, int thread, const IntervalRing& ring) {
+    for (size_t i = 0; i < ring.Size(); i++) {
+        const IntervalSample& s = ring[i];
+        double seconds = s.seconds > 0 ? s.seconds : 1;
+        fputc('"', f);
+        for (const char* c = test; *c; c++) {
+            if (*c == '"') fputc('"', f);
+            fputc(*c, f);
+        }
+        fprintf(f, "\",%d,%.3f,%.3f,%lld,%lld,%.1f,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+                thread, s.time, s.seconds, s.ops, s.bytes, s.ops / seconds,
+                s.bytes / 1024.0 / seconds, s.mean / 1e3, s.p50 / 1e3, s.p99 / 1e3,
+                s.p999 / 1e3, s.max / 1e3);
+    }
+}
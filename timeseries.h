@@ -0,0 +1,60 @@
+/*
+ * DiskTest - per-interval results
+ *
+ * A test's overall throughput hides what happened during it: an SSD whose
+ * SLC cache fills part way through a long write, a drive throttling as it
+ * heats up, or garbage collection stalls all average away.  With interval
+ * logging on, each worker closes an IntervalSample every interval (100 ms,
+ * say) with the IOs that completed in it and their latency percentiles,
+ * and keeps the samples in an IntervalRing allocated before the run, so
+ * recording never allocates.  The samples are written out once the test
+ * has finished.
+ */
+
+#ifndef DISKTEST_TIMESERIES_H
+#define DISKTEST_TIMESERIES_H
+
+#include <stdio.h>
+#include <vector>
+
+struct IntervalSample {
+    double time;          // Seconds from the end of the ramp to the end of the interval
+    double seconds;       // Length of the interval (the last may be short)
+    long long ops;
+    long long bytes;
+    long long mean;       // Latency in nanoseconds, reads and writes together
+    long long p50;
+    long long p99;
+    long long p999;
+    long long max;
+};
+
+// Fixed-size ring of samples; once full, each new sample replaces the oldest
+class IntervalRing {
+public:
+    IntervalRing();
+
+    // Empty the ring and make room for capacity samples
+    void Reset(size_t capacity);
+    void Add(const IntervalSample& sample);
+
+    size_t Size() const { return count; }
+    long long Dropped() const { return dropped; }
+    // Oldest first
+    const IntervalSample& operator[](size_t index) const {
+        return samples[(first + index) % samples.size()];
+    }
+
+private:
+    std::vector<IntervalSample> samples;
+    size_t first;
+    size_t count;
+    long long dropped;    // Overwritten because the ring was full
+};
+
+// Column names for WriteIntervals, as a CSV header line
+void WriteIntervalHeader(FILE* f);
+// One CSV line per sample of ring, for thread of the named test
+void WriteIntervals(FILE* f, const char* test, int thread, const IntervalRing& ring);
+
+#endif // DISKTEST_TIMESERIES_H
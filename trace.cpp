@@ -0,0 +1,447 @@
+/*
+ * DiskTest - IO trace import and replay
+ */
+
+#include "trace.h"
+#include "bufferpool.h"
+#include "ioengine.h"
+#include "platform.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <memory>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char TRACE_MAGIC[8] = "DTTRACE";
+
+// Bytes of trace mapped at once, and the boundary windows start on (the
+// Windows allocation granularity, a multiple of every page size)
+const long long TRACE_WINDOW = 64LL * 1024 * 1024;
+const long long TRACE_GRANULE = 65536;
+
+// Parse one line of CSV (seconds,op,offset,length) into up to two records
+// timed in seconds; returns the number, or -1 if it is not a CSV record
+static int ParseCsvLine(const char* line, double& seconds, TraceRecord* records) {
+    char op[16];
+    long long offset = 0, length = 0;
+    int n = sscanf(line, " %lf , %15[^, \t\r\n] , %lld , %lld", &seconds, op, &offset, &length);
+    if (n < 2) return -1;
+    TraceRecord& r = records[0];
+    memset(&r, 0, sizeof(r));
+    switch (toupper((unsigned char)op[0])) {
+    case 'R': r.op = TRACE_READ; break;
+    case 'W': r.op = TRACE_WRITE; break;
+    case 'F': r.op = TRACE_FLUSH; return 1;
+    default: return -1;
+    }
+    if (n < 4 || offset < 0 || length <= 0 || length > 0x7FFFFFFF) return -1;
+    r.offset = (uint64_t)offset;
+    r.length = (uint32_t)length;
+    return 1;
+}
+
+// Parse one line of blkparse output into up to two records (a flush and a
+// write for a write with preflush); returns the number, 0 for events other
+// than Q, or -1 if it is not a blkparse event
+static int ParseBlkparseLine(const char* line, double& seconds, TraceRecord* records) {
+    char device[16], action[4], rwbs[8];
+    int cpu, pid;
+    unsigned sequence, blocks = 0;
+    unsigned long long sector = 0;
+    int n = sscanf(line, "%15s %d %u %lf %d %3s %7s %llu + %u", device, &cpu, &sequence,
+                   &seconds, &pid, action, rwbs, &sector, &blocks);
+    if (n < 7 || !strchr(device, ',')) return -1;
+    if (strcmp(action, "Q") != 0) return 0;
+
+    int count = 0;
+    // A leading F is a flush before the IO; discards (D) are not replayed
+    if (rwbs[0] == 'F') {
+        memset(&records[count], 0, sizeof(TraceRecord));
+        records[count++].op = TRACE_FLUSH;
+    }
+    bool write = strchr(rwbs, 'W') != NULL;
+    if (n == 9 && blocks > 0 && !strchr(rwbs, 'D') && (write || strchr(rwbs, 'R'))) {
+        TraceRecord& r = records[count++];
+        memset(&r, 0, sizeof(r));
+        r.op = write ? TRACE_WRITE : TRACE_READ;
+        r.offset = sector * 512;
+        r.length = blocks * 512;
+    }
+    return count;
+}
+
+bool ImportTrace(const char* source, const char* path) {
+    FILE* in = fopen(source, "r");
+    if (!in) {
+        printf("Cannot open trace %s\n", source);
+        return false;
+    }
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        printf("Cannot write trace %s\n", path);
+        fclose(in);
+        return false;
+    }
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.recordSize = sizeof(TraceRecord);
+    fwrite(&header, sizeof(header), 1, out); // Filled in at the end
+
+    // The format is decided by the first line that parses as either; after
+    // that blkparse's other lines (its summary) are skipped, but a CSV line
+    // that does not parse is an error
+    enum { UNKNOWN, CSV, BLKPARSE } format = UNKNOWN;
+    char line[512];
+    int number = 0;
+    double first = 0;
+    long long counts[3] = {0, 0, 0};
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), in)) {
+        number++;
+        const char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#') continue;
+
+        double seconds = 0;
+        TraceRecord records[2];
+        int count = -1;
+        if (format != CSV) {
+            count = ParseBlkparseLine(p, seconds, records);
+            if (count >= 0) format = BLKPARSE;
+        }
+        if (count < 0 && format != BLKPARSE) {
+            count = ParseCsvLine(p, seconds, records);
+            if (count >= 0) format = CSV;
+        }
+        if (count < 0) {
+            // A CSV header line, or blkparse's summary
+            if (format == BLKPARSE || (format == UNKNOWN && !isdigit((unsigned char)*p))) {
+                continue;
+            }
+            printf("%s line %d: expected seconds,op,offset,length\n", source, number);
+            ok = false;
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            TraceRecord& r = records[i];
+            if (header.records == 0) first = seconds;
+            // Times never go backwards, so replay can take them in order
+            double time = (seconds - first) * 1e9;
+            r.time = time > (double)header.duration ? (uint64_t)time : header.duration;
+            header.duration = r.time;
+            if (r.offset + r.length > header.extent) header.extent = r.offset + r.length;
+            if (r.length > header.maxLength) header.maxLength = r.length;
+            counts[r.op]++;
+            header.records++;
+            fwrite(&r, sizeof(r), 1, out);
+        }
+    }
+    fclose(in);
+
+    if (ok && header.records == 0) {
+        printf("No IOs found in %s\n", source);
+        ok = false;
+    }
+    if (ok) {
+        fseek(out, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, out);
+        if (ferror(out)) {
+            printf("Error writing trace %s\n", path);
+            ok = false;
+        }
+    }
+    if (fclose(out) != 0) ok = false;
+    if (!ok) {
+        remove(path);
+        return false;
+    }
+    printf("Imported %lld IOs (%lld reads, %lld writes, %lld flushes) over %.1f s from %s to %s.\n",
+           (long long)header.records, counts[TRACE_READ], counts[TRACE_WRITE],
+           counts[TRACE_FLUSH], header.duration / 1e9, source, path);
+    return true;
+}
+
+#ifdef _WIN32
+TraceReader::TraceReader()
+    : fileSize(0), windowStart(0), windowSize(0), window(NULL), hFile(INVALID_HANDLE_VALUE),
+      hMapping(NULL) {
+}
+#else
+TraceReader::TraceReader() : fileSize(0), windowStart(0), windowSize(0), window(NULL), fd(-1) {
+}
+#endif
+
+TraceReader::~TraceReader() {
+    Close();
+}
+
+bool TraceReader::Open(const char* path) {
+    Close();
+#ifdef _WIN32
+    hFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER size;
+    if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &size)) {
+        printf("Cannot open trace %s\n", path);
+        Close();
+        return false;
+    }
+    fileSize = size.QuadPart;
+    if (fileSize > 0) hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+#else
+    fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("Cannot open trace %s\n", path);
+        Close();
+        return false;
+    }
+    fileSize = st.st_size;
+#endif
+    if (fileSize < (long long)sizeof(TraceHeader) || !Map(0)) {
+        printf("%s is not a DiskTest trace.\n", path);
+        Close();
+        return false;
+    }
+    memcpy(&header, window, sizeof(header));
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION || header.recordSize < sizeof(TraceRecord) ||
+        (fileSize - (long long)sizeof(header)) / header.recordSize < (long long)header.records) {
+        printf("%s is not a DiskTest trace, or is damaged.\n", path);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void TraceReader::Close() {
+    Unmap();
+#ifdef _WIN32
+    if (hMapping) CloseHandle(hMapping);
+    if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+    hMapping = NULL;
+    hFile = INVALID_HANDLE_VALUE;
+#else
+    if (fd >= 0) close(fd);
+    fd = -1;
+#endif
+    fileSize = 0;
+}
+
+bool TraceReader::Get(uint64_t index, TraceRecord& record) {
+    long long position = (long long)sizeof(TraceHeader) + (long long)(index * header.recordSize);
+    if (position < windowStart || position + (long long)sizeof(record) > windowStart + windowSize) {
+        if (!Map(position)) return false;
+    }
+    memcpy(&record, window + (position - windowStart), sizeof(record));
+    return true;
+}
+
+// Map the window holding file offset position
+bool TraceReader::Map(long long position) {
+    Unmap();
+    windowStart = position - position % TRACE_GRANULE;
+    windowSize = fileSize - windowStart < TRACE_WINDOW ? fileSize - windowStart : TRACE_WINDOW;
+    if (windowSize <= 0) return false;
+#ifdef _WIN32
+    if (!hMapping) return false;
+    window = (char*)MapViewOfFile(hMapping, FILE_MAP_READ, (DWORD)(windowStart >> 32),
+                                  (DWORD)windowStart, (SIZE_T)windowSize);
+    if (!window) return false;
+#else
+    void* p = mmap(NULL, (size_t)windowSize, PROT_READ, MAP_SHARED, fd, (off_t)windowStart);
+    if (p == MAP_FAILED) return false;
+    window = (char*)p;
+    posix_madvise(window, (size_t)windowSize, POSIX_MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void TraceReader::Unmap() {
+    if (!window) return;
+#ifdef _WIN32
+    UnmapViewOfFile(window);
+#else
+    munmap(window, (size_t)windowSize);
+#endif
+    window = NULL;
+    windowStart = windowSize = 0;
+}
+
+// Where record r lands in a file of size bytes: its length rounded up to
+// alignment and cut to the buffers, and its offset aligned down, wrapping
+// round if it is beyond the end
+static void Place(const TraceRecord& r, long long size, long alignment, long longest,
+                  long long& offset, long& length) {
+    long long n = r.length > 0 ? r.length : alignment;
+    n = (n + alignment - 1) / alignment * alignment;
+    if (n > longest) n = longest;
+    if (n > size) n = size - size % alignment;
+    long long o = (long long)r.offset;
+    if (o + n > size) o %= size - n + 1;
+    offset = o - o % alignment;
+    length = (long)n;
+}
+
+bool ReplayTrace(TraceReader& trace, const Workload& w, double speed, bool readonly,
+                 WorkerStats& stats, RunResult& result, long long& skipped) {
+    stats.cpu = -1;
+    stats.ops = stats.bytes = stats.errors = stats.flushes = 0;
+    stats.elapsed = 0;
+    stats.readLatency.Reset();
+    stats.writeLatency.Reset();
+    stats.commitLatency.Reset();
+    stats.intervals.Reset(0);
+    result = RunResult();
+    skipped = 0;
+
+    int mode = readonly ? IO_READ : IO_READ | IO_WRITE;
+    if (w.direct) mode |= IO_DIRECT;
+    std::unique_ptr<IOEngine> file(CreateEngine(w.engine, w.queueDepth));
+    if (!file || !file->Open(w.path, mode)) return false;
+
+    // One buffer per request slot, big enough for the longest IO
+    const TraceHeader& header = trace.Header();
+    long alignment = w.direct && w.alignment > 0 ? w.alignment : 1;
+    long longest = header.maxLength < (uint32_t)MAX_TRANSFER ? (long)header.maxLength : MAX_TRANSFER;
+    longest = (longest + alignment - 1) / alignment * alignment;
+    if (longest < 512) longest = 512;
+    int depth = file->QueueDepth();
+    BufferPool pool;
+    if (!pool.Allocate(depth, longest, alignment)) {
+        fprintf(stderr, "Out of memory for transfer buffers\n");
+        return false;
+    }
+    std::vector<IORequest> requests(depth);
+    std::vector<IORequest*> idle(depth);
+    std::vector<void*> slots(depth);
+    for (int i = 0; i < depth; i++) {
+        slots[i] = pool.Slot(i);
+        memset(slots[i], 0x5A, longest);
+        requests[i].buffer = slots[i];
+        requests[i].bufferIndex = i;
+        idle[i] = &requests[i];
+    }
+    if (!file->RegisterBuffers(slots.data(), depth, longest)) {
+        for (int i = 0; i < depth; i++) requests[i].bufferIndex = -1;
+    }
+
+    const long long SHOW_INTERVAL = 500000000;
+    std::unique_ptr<ProgressLine> line(w.progress && IsConsole() ? new ProgressLine() : NULL);
+    std::vector<IORequest*> batch(depth);
+    uint64_t next = 0;        // Next record to issue
+    TraceRecord record;
+    bool loaded = false;      // record holds record next
+    long long start = ClockNanos();
+    long long nextShow = start + SHOW_INTERVAL;
+
+    while (next < header.records || (int)idle.size() < depth) {
+        long long now = ClockNanos();
+        int count = 0;
+        bool draining = false; // A flush is waiting for the IOs before it
+        while (next < header.records) {
+            if (!loaded && !trace.Get(next, record)) {
+                fprintf(stderr, "Cannot read trace record %llu\n", (unsigned long long)next);
+                stats.errors++;
+                next = header.records;
+                break;
+            }
+            loaded = true;
+            long long due = speed > 0 ? start + (long long)(record.time / speed) : now;
+            if (due > now) break; // Not yet
+            if (readonly && record.op != TRACE_READ) {
+                skipped++;
+                next++;
+                loaded = false;
+                continue;
+            }
+            if (record.op == TRACE_FLUSH) {
+                if (count > 0 || (int)idle.size() < depth) {
+                    draining = true;
+                    break;
+                }
+                if (!file->Flush(false)) stats.errors++;
+                now = ClockNanos();
+                stats.commitLatency.Record(now - due);
+                stats.flushes++;
+                stats.ops++;
+                next++;
+                loaded = false;
+                continue;
+            }
+            if (idle.empty()) break;
+
+            IORequest* request = idle.back();
+            idle.pop_back();
+            Place(record, w.size, alignment, longest, request->offset, request->length);
+            request->write = record.op == TRACE_WRITE;
+            request->issueTime = due;
+            batch[count++] = request;
+            next++;
+            loaded = false;
+        }
+        int submitted = count > 0 ? file->Submit(batch.data(), count) : 0;
+        if (submitted != count) {
+            // Those not accepted were never queued; stop, and drain the rest
+            fprintf(stderr, "Submit error\n");
+            stats.errors++;
+            for (int i = submitted < 0 ? 0 : submitted; i < count; i++) idle.push_back(batch[i]);
+            next = header.records;
+        }
+        if ((int)idle.size() == depth) {
+            if (loaded && speed > 0) WaitUntil(start + (long long)(record.time / speed));
+            continue;
+        }
+
+        // At original timing with a slot free, only poll, so the next IO
+        // is not held up waiting for this one
+        bool poll = speed > 0 && !draining && !idle.empty() && next < header.records;
+        int done = file->Reap(batch.data(), poll ? 0 : 1, depth);
+        if (done == 0) std::this_thread::yield();
+        if (done < 0) {
+            fprintf(stderr, "I/O completion error\n");
+            stats.errors++;
+            break;
+        }
+        now = ClockNanos();
+        for (int i = 0; i < done; i++) {
+            IORequest* request = batch[i];
+            idle.push_back(request);
+            if (request->result < 0) {
+                stats.errors++;
+            } else {
+                stats.bytes += request->result;
+            }
+            long long latency = now - request->issueTime;
+            if (request->write) {
+                stats.writeLatency.Record(latency);
+            } else {
+                stats.readLatency.Record(latency);
+            }
+            stats.ops++;
+        }
+        if (line && now >= nextShow) {
+            char text[32];
+            snprintf(text, sizeof(text), "[%.0f%%]", 100.0 * next / header.records);
+            line->Show(text);
+            nextShow = now + SHOW_INTERVAL;
+        }
+    }
+
+    if (line) line->Clear();
+    stats.elapsed = (ClockNanos() - start) / 1e9;
+    if (stats.elapsed <= 0) stats.elapsed = 0.01; // Prevent division by zero
+    result.elapsed = stats.elapsed;
+    file->Close();
+    return true;
+}
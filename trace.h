@@ -0,0 +1,106 @@
+/*
+ * DiskTest - IO trace import and replay
+ *
+ * A trace is a recording of an application's IOs: when each was issued,
+ * where, how big, and whether it was a read, a write or a flush.  Replaying
+ * one against the test file reproduces the application's real pattern
+ * rather than a synthetic mix.
+ *
+ * Traces are kept in a compact binary file: a TraceHeader followed by one
+ * fixed-size TraceRecord per IO in time order, little-endian.  They are
+ * made by importing either CSV lines of
+ *
+ *   seconds,op,offset,length      op is R, W or F (flush)
+ *
+ * or blkparse text output, of which the Q (queued) events are used: those
+ * are the IOs as the application asked for them, before the block layer
+ * merged or split them.
+ *
+ * A trace can be far larger than memory, so TraceReader maps only a window
+ * of the file at a time and slides it forward as the records are read.
+ * Replay issues each record at its original time (scaled by speed) on one
+ * thread, up to the engine's queue depth in flight.  Like a rate limited
+ * run, latency counts from when an IO was due, so one held up behind a slow
+ * IO is charged for the wait.  A flush waits for the IOs before it to
+ * complete, then flushes the file; its latency is reported as commit
+ * latency.
+ */
+
+#ifndef DISKTEST_TRACE_H
+#define DISKTEST_TRACE_H
+
+#include "worker.h"
+#include <stdint.h>
+
+enum TraceOp { TRACE_READ, TRACE_WRITE, TRACE_FLUSH };
+
+struct TraceHeader {
+    char magic[8];        // "DTTRACE" and a zero
+    uint32_t version;     // TRACE_VERSION
+    uint32_t recordSize;  // sizeof(TraceRecord) when written
+    uint64_t records;
+    uint64_t extent;      // Highest offset + length of any record
+    uint64_t duration;    // Nanoseconds from the first record to the last
+    uint32_t maxLength;   // Longest transfer
+    uint32_t reserved;
+};
+
+struct TraceRecord {
+    uint64_t time;        // Nanoseconds after the first record
+    uint64_t offset;      // Bytes
+    uint32_t length;      // Bytes; 0 for a flush
+    uint16_t op;          // TraceOp
+    uint16_t reserved;
+};
+
+const uint32_t TRACE_VERSION = 1;
+
+// Convert a CSV or blkparse trace to the binary format.  Reports the first
+// error with its line number and returns false.
+bool ImportTrace(const char* source, const char* path);
+
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    // Check the header and map the first records; false, with a message,
+    // if path is not a trace
+    bool Open(const char* path);
+    void Close();
+
+    const TraceHeader& Header() const { return header; }
+    // Record index, which must be below Header().records; reading in order
+    // only ever maps a window of the file.  False if it cannot be mapped.
+    bool Get(uint64_t index, TraceRecord& record);
+
+private:
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
+
+    bool Map(long long offset);
+    void Unmap();
+
+    TraceHeader header;
+    long long fileSize;
+    long long windowStart; // File offset of the mapped window
+    long long windowSize;
+    char* window;
+#ifdef _WIN32
+    void* hFile;
+    void* hMapping;
+#else
+    int fd;
+#endif
+};
+
+// Replay the trace against w.path, opened with w.engine at w.queueDepth
+// (w.direct aligns offsets and lengths to w.alignment).  Offsets beyond
+// w.size wrap round.  speed scales the original timing, 0 issues every IO
+// as soon as a request slot is free.  readonly skips the writes and
+// flushes, counting them in skipped.  Returns false if the file cannot be
+// opened.
+bool ReplayTrace(TraceReader& trace, const Workload& w, double speed, bool readonly,
+                 WorkerStats& stats, RunResult& result, long long& skipped);
+
+#endif // DISKTEST_TRACE_H
@@ -0,0 +1,518 @@
+/*
+ * DiskTest - pattern fill and compare kernels
+ */
+
+#include "verify.h"
+#include "random.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VERIFY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_SSE42
+#endif
+
+// Bits set in x, without needing the POPCNT instruction
+static int BitCount(unsigned int x) {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    return (int)((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+// Index of the lowest set bit of a non-zero x
+static int LowestBit(unsigned int x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Word-by-word comparison of [start, bytes), adding to result
+static void CompareTail(const unsigned char* expected, const unsigned char* actual,
+                        size_t start, size_t bytes, CompareResult& result) {
+    for (size_t i = start; i + 1 < bytes; i += 2) {
+        if (expected[i] == actual[i] && expected[i + 1] == actual[i + 1]) continue;
+        if (result.firstMismatch < 0) {
+            result.firstMismatch = (long long)(expected[i] != actual[i] ? i : i + 1);
+        }
+        result.badWords++;
+    }
+}
+
+// Account for one vector of n bytes at offset whose byte-equality mask
+// (bit per byte, set if equal) is not all ones
+static void CountMismatches(unsigned int byteEqual, int n, size_t offset,
+                            CompareResult& result) {
+    unsigned int differ = ~byteEqual & (n == 32 ? 0xFFFFFFFFu : (1u << n) - 1);
+    if (result.firstMismatch < 0) result.firstMismatch = (long long)(offset + LowestBit(differ));
+    // A word is bad if either of its bytes is; fold each pair onto its low bit
+    result.badWords += BitCount((differ | (differ >> 1)) & 0x55555555u);
+}
+
+static void FillScalar(void* dst, size_t bytes, const unsigned char* period) {
+    unsigned char* p = (unsigned char*)dst;
+    size_t i = 0;
+    for (; i + PATTERN_PERIOD <= bytes; i += PATTERN_PERIOD) {
+        memcpy(p + i, period, PATTERN_PERIOD);
+    }
+    memcpy(p + i, period, bytes - i);
+}
+
+static CompareResult CompareScalar(const void* expected, const void* actual, size_t bytes) {
+    const unsigned char* e = (const unsigned char*)expected;
+    const unsigned char* a = (const unsigned char*)actual;
+    CompareResult result = {-1, 0};
+    size_t i = 0;
+    // Skip matching 8-byte chunks quickly, then look at the words
+    for (; i + 8 <= bytes; i += 8) {
+        unsigned long long x, y;
+        memcpy(&x, e + i, 8);
+        memcpy(&y, a + i, 8);
+        if (x != y) CompareTail(e, a, i, i + 8, result);
+    }
+    CompareTail(e, a, i, bytes, result);
+    return result;
+}
+
+// Slicing-by-8 tables for the reflected Castagnoli polynomial
+struct CrcTables {
+    unsigned int t[8][256];
+
+    CrcTables() {
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int crc = i;
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+            t[0][i] = crc;
+        }
+        for (unsigned int i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+        }
+    }
+};
+
+static unsigned int Crc32cScalar(unsigned int crc, const void* data, size_t bytes) {
+    static const CrcTables tables;
+    const unsigned int (*t)[256] = tables.t;
+    const unsigned char* p = (const unsigned char*)data;
+    for (; bytes >= 8; p += 8, bytes -= 8) {
+        unsigned int low, high;
+        memcpy(&low, p, 4);
+        memcpy(&high, p + 4, 4);
+        low ^= crc; // Little-endian, as every platform DiskTest runs on
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^
+              t[4][low >> 24] ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+              t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    }
+    for (; bytes > 0; p++, bytes--) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+    return crc;
+}
+
+#ifdef VERIFY_X86
+
+TARGET_SSE42 static unsigned int Crc32cSSE42(unsigned int crc, const void* data, size_t bytes) {
+    const unsigned char* p = (const unsigned char*)data;
+#if defined(__x86_64__) || defined(_M_X64)
+    unsigned long long crc64 = crc;
+    for (; bytes >= 8; p += 8, bytes -= 8) {
+        unsigned long long word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (unsigned int)crc64;
+#endif
+    for (; bytes >= 4; p += 4, bytes -= 4) {
+        unsigned int word;
+        memcpy(&word, p, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; bytes > 0; p++, bytes--) crc = _mm_crc32_u8(crc, *p);
+    return crc;
+}
+
+TARGET_SSE2 static void FillSSE2(void* dst, size_t bytes, const unsigned char* period) {
+    unsigned char* p = (unsigned char*)dst;
+    __m128i low = _mm_loadu_si128((const __m128i*)period);
+    __m128i high = _mm_loadu_si128((const __m128i*)(period + 16));
+    size_t i = 0;
+    for (; i + PATTERN_PERIOD <= bytes; i += PATTERN_PERIOD) {
+        _mm_storeu_si128((__m128i*)(p + i), low);
+        _mm_storeu_si128((__m128i*)(p + i + 16), high);
+    }
+    memcpy(p + i, period, bytes - i);
+}
+
+TARGET_SSE2 static CompareResult CompareSSE2(const void* expected, const void* actual,
+                                             size_t bytes) {
+    const unsigned char* e = (const unsigned char*)expected;
+    const unsigned char* a = (const unsigned char*)actual;
+    CompareResult result = {-1, 0};
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(e + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(a + i));
+        unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        if (equal != 0xFFFF) CountMismatches(equal, 16, i, result);
+    }
+    CompareTail(e, a, i, bytes, result);
+    return result;
+}
+
+TARGET_AVX2 static void FillAVX2(void* dst, size_t bytes, const unsigned char* period) {
+    unsigned char* p = (unsigned char*)dst;
+    __m256i pattern = _mm256_loadu_si256((const __m256i*)period);
+    size_t i = 0;
+    for (; i + 2 * PATTERN_PERIOD <= bytes; i += 2 * PATTERN_PERIOD) {
+        _mm256_storeu_si256((__m256i*)(p + i), pattern);
+        _mm256_storeu_si256((__m256i*)(p + i + 32), pattern);
+    }
+    for (; i + PATTERN_PERIOD <= bytes; i += PATTERN_PERIOD) {
+        _mm256_storeu_si256((__m256i*)(p + i), pattern);
+    }
+    memcpy(p + i, period, bytes - i);
+}
+
+TARGET_AVX2 static CompareResult CompareAVX2(const void* expected, const void* actual,
+                                             size_t bytes) {
+    const unsigned char* e = (const unsigned char*)expected;
+    const unsigned char* a = (const unsigned char*)actual;
+    CompareResult result = {-1, 0};
+    size_t i = 0;
+    // 64 bytes per pass while they match, which is almost always
+    for (; i + 64 <= bytes; i += 64) {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(e + i)),
+                                        _mm256_loadu_si256((const __m256i*)(a + i)));
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(e + i + 32)),
+                                        _mm256_loadu_si256((const __m256i*)(a + i + 32)));
+        if (_mm256_movemask_epi8(_mm256_and_si256(eq0, eq1)) == -1) continue;
+        unsigned int equal0 = (unsigned int)_mm256_movemask_epi8(eq0);
+        unsigned int equal1 = (unsigned int)_mm256_movemask_epi8(eq1);
+        if (equal0 != 0xFFFFFFFFu) CountMismatches(equal0, 32, i, result);
+        if (equal1 != 0xFFFFFFFFu) CountMismatches(equal1, 32, i + 32, result);
+    }
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(e + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(a + i));
+        unsigned int equal = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (equal != 0xFFFFFFFFu) CountMismatches(equal, 32, i, result);
+    }
+    CompareTail(e, a, i, bytes, result);
+    return result;
+}
+
+// AVX2 needs both the instructions and the OS saving the YMM registers
+static bool HaveAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool HaveSSE2() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return true; // Part of the architecture
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool HaveSSE42() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#endif // VERIFY_X86
+
+// Probed once, on first use (thread-safe as a function-local static)
+struct KernelTable {
+    VerifyKernel kernels[3];
+    int count;
+    unsigned int (*crc)(unsigned int crc, const void* data, size_t bytes);
+    const char* crcName;
+
+    KernelTable() : count(0), crc(Crc32cScalar), crcName("scalar") {
+        Add("scalar", FillScalar, CompareScalar);
+#ifdef VERIFY_X86
+        if (HaveSSE2()) Add("SSE2", FillSSE2, CompareSSE2);
+        if (HaveAVX2()) Add("AVX2", FillAVX2, CompareAVX2);
+        if (HaveSSE42()) {
+            crc = Crc32cSSE42;
+            crcName = "SSE4.2";
+        }
+#endif
+    }
+
+    void Add(const char* name, void (*fill)(void*, size_t, const unsigned char*),
+             CompareResult (*compare)(const void*, const void*, size_t)) {
+        kernels[count].name = name;
+        kernels[count].fill = fill;
+        kernels[count].compare = compare;
+        count++;
+    }
+};
+
+static const KernelTable& Kernels() {
+    static KernelTable table;
+    return table;
+}
+
+const VerifyKernel* VerifyKernels(int& count) {
+    count = Kernels().count;
+    return Kernels().kernels;
+}
+
+static const VerifyKernel& BestKernel() {
+    return Kernels().kernels[Kernels().count - 1];
+}
+
+void FillPattern(void* dst, size_t bytes, const unsigned short* words, int count) {
+    unsigned short period[PATTERN_PERIOD / 2];
+    for (int i = 0; i < PATTERN_PERIOD / 2; i++) period[i] = words[i % count];
+    BestKernel().fill(dst, bytes, (const unsigned char*)period);
+}
+
+CompareResult CompareBlocks(const void* expected, const void* actual, size_t bytes) {
+    return BestKernel().compare(expected, actual, bytes);
+}
+
+unsigned int Crc32c(const void* data, size_t bytes, unsigned int crc) {
+    return ~Kernels().crc(~crc, data, bytes);
+}
+
+const char* Crc32cKernel() {
+    return Kernels().crcName;
+}
+
+// Report a kernel whose result is not the word loop's
+static bool SameResult(const char* name, size_t bytes, CompareResult got, CompareResult want) {
+    if (got.firstMismatch == want.firstMismatch && got.badWords == want.badWords) return true;
+    printf("%s compare of %d bytes: first difference %lld, %lld bad words; expected %lld, %lld\n",
+           name, (int)bytes, got.firstMismatch, got.badWords, want.firstMismatch, want.badWords);
+    return false;
+}
+
+bool CheckKernels() {
+    bool ok = true;
+    const char* check = "123456789";
+    if (Crc32c(check, 9) != 0xE3069283 || ~Crc32cScalar(~0u, check, 9) != 0xE3069283) {
+        printf("CRC32C of \"123456789\" is not E3069283.\n");
+        ok = false;
+    }
+
+    // Every length and alignment the 8, 4 and 1 byte steps split differently
+    std::vector<unsigned char> data(1024 + 8);
+    Random random(1);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (unsigned char)random.Next();
+    bool same = true; // Reported once
+    for (size_t start = 0; start < 8 && same; start++) {
+        for (size_t bytes = 0; bytes <= 1024 && same; bytes++) {
+            same = Kernels().crc(~0u, &data[start], bytes) == Crc32cScalar(~0u, &data[start], bytes);
+            if (!same) {
+                printf("%s CRC32C of %d bytes differs from the table version.\n", Crc32cKernel(),
+                       (int)bytes);
+                ok = false;
+            }
+        }
+    }
+
+    int count;
+    const VerifyKernel* kernels = VerifyKernels(count);
+    unsigned char period[PATTERN_PERIOD];
+    for (int i = 0; i < PATTERN_PERIOD; i++) period[i] = (unsigned char)(0x3C ^ (i * 7));
+    const size_t BLOCK = 32768, GUARD = 64;
+    std::vector<unsigned char> expected(BLOCK + GUARD), actual(BLOCK + GUARD);
+    // Lengths around each kernel's 16, 32 and 64 byte steps, and a full block
+    const size_t sizes[] = {2, 14, 16, 18, 30, 32, 34, 62, 64, 66, 96, 126, 128, 130, 1000, BLOCK};
+    for (int k = 1; k < count; k++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            size_t bytes = sizes[s];
+            memset(&expected[0], 0xEE, expected.size());
+            memset(&actual[0], 0xEE, actual.size());
+            kernels[0].fill(&expected[0], bytes, period);
+            kernels[k].fill(&actual[0], bytes, period);
+            if (memcmp(&expected[0], &actual[0], expected.size()) != 0) {
+                printf("%s fill of %d bytes differs from scalar.\n", kernels[k].name, (int)bytes);
+                ok = false;
+            }
+        }
+    }
+
+    // Differences at the edges of every vector width, in both bytes of one
+    // word, and then scattered at random, checked against a plain word loop
+    kernels[0].fill(&expected[0], BLOCK, period);
+    const size_t edges[] = {15, 16, 31, 32, 63, 64, 65, BLOCK - 64, BLOCK - 33, BLOCK - 1};
+    for (int round = 0; round < 64; round++) {
+        memcpy(&actual[0], &expected[0], BLOCK);
+        size_t plants = round == 0 ? sizeof(edges) / sizeof(edges[0]) : (size_t)round;
+        for (size_t i = 0; i < plants; i++) {
+            size_t at = round == 0 ? edges[i] : (size_t)random.Below(BLOCK);
+            actual[at] ^= (unsigned char)(1 + random.Below(255));
+        }
+        if (round == 0) actual[14] ^= 0x80;
+        // Odd lengths too, where the tail loop finishes the block
+        const size_t lengths[2] = {BLOCK, BLOCK - 42};
+        for (int l = 0; l < 2; l++) {
+            CompareResult want = {-1, 0};
+            CompareTail(&expected[0], &actual[0], 0, lengths[l], want);
+            if (round == 0 && l == 0 && (want.firstMismatch != 14 || want.badWords != 9)) {
+                printf("Planted differences were not found by the word loop.\n");
+                ok = false;
+            }
+            for (int k = 0; k < count; k++) {
+                CompareResult got = kernels[k].compare(&expected[0], &actual[0], lengths[l]);
+                if (!SameResult(kernels[k].name, lengths[l], got, want)) ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+const char* const BLOCK_STATUS_NAMES[BLOCK_STATUSES] = {"good", "corrupt", "misplaced", "stale",
+                                                        "foreign"};
+
+// Everything after the crc field, which is what it covers
+static unsigned int BlockCrc(const void* block, size_t bytes) {
+    const size_t start = offsetof(BlockHeader, offset);
+    return Crc32c((const unsigned char*)block + start, bytes - start);
+}
+
+void FillBlock(void* dst, size_t bytes, long long offset, unsigned long long generation,
+               unsigned long long seed) {
+    BlockHeader header;
+    header.magic = BLOCK_MAGIC;
+    header.crc = 0;
+    header.offset = (unsigned long long)offset;
+    header.generation = generation;
+    header.seed = seed;
+    unsigned char* p = (unsigned char*)dst;
+    memcpy(p, &header, sizeof(header));
+
+    // Payload keyed by all three, so no two blocks or passes match
+    unsigned long long key = seed ^ (header.offset * 0x9E3779B97F4A7C15ULL);
+    Random random(SplitMix64(key) ^ generation);
+    for (size_t i = sizeof(header); i + 8 <= bytes; i += 8) {
+        unsigned long long word = random.Next();
+        memcpy(p + i, &word, 8);
+    }
+
+    header.crc = BlockCrc(dst, bytes);
+    memcpy(p + offsetof(BlockHeader, crc), &header.crc, sizeof(header.crc));
+}
+
+BlockCheck CheckBlock(const void* src, size_t bytes, long long offset,
+                      unsigned long long generation, unsigned long long seed) {
+    BlockCheck check = {BLOCK_CORRUPT, -1, 0};
+    BlockHeader header;
+    memcpy(&header, src, sizeof(header));
+    if (header.magic != BLOCK_MAGIC || header.crc != BlockCrc(src, bytes)) return check;
+
+    // The CRC covers the payload too, so an intact header vouches for it
+    check.foundOffset = (long long)header.offset;
+    check.foundGeneration = header.generation;
+    if (header.seed != seed) {
+        check.status = BLOCK_FOREIGN;
+    } else if (check.foundOffset != offset) {
+        check.status = BLOCK_MISPLACED;
+    } else if (header.generation != generation) {
+        check.status = BLOCK_STALE;
+    } else {
+        check.status = BLOCK_GOOD;
+    }
+    return check;
+}
+
+bool CheckBlocks() {
+    bool ok = true;
+    const long long OFFSET = 1 << 20;
+    const unsigned long long GENERATION = 3, SEED = 0x1234567;
+    // Each read of a block written for OFFSET, GENERATION and SEED; damage
+    // is a byte flipped at that position, or -1 for none
+    struct Case {
+        const char* name; // BLOCK_STATUS_NAMES of the result
+        long long offset;
+        unsigned long long generation;
+        unsigned long long seed;
+        int damage;
+    };
+    const Case cases[] = {
+        {"good", OFFSET, GENERATION, SEED, -1},
+        {"corrupt", OFFSET, GENERATION, SEED, 0},              // Magic
+        {"corrupt", OFFSET, GENERATION, SEED, 4},              // CRC
+        {"corrupt", OFFSET, GENERATION, SEED, 8},              // Offset in the header
+        {"corrupt", OFFSET, GENERATION, SEED, 40},             // Payload
+        {"misplaced", OFFSET + 32768, GENERATION, SEED, -1},
+        {"stale", OFFSET, GENERATION + 1, SEED, -1},
+        {"foreign", OFFSET, GENERATION, SEED + 1, -1},
+        {"foreign", OFFSET - 32768, GENERATION + 1, SEED + 1, -1}, // Run checked first
+        {"misplaced", OFFSET + 32768, GENERATION + 1, SEED, -1},   // Then offset
+    };
+    const size_t sizes[] = {sizeof(BlockHeader) + 16, 4096, 32768};
+    std::vector<unsigned char> block(32768);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+            const Case& test = cases[c];
+            FillBlock(&block[0], sizes[s], OFFSET, GENERATION, SEED);
+            if (test.damage >= 0) block[test.damage] ^= 0x10;
+            BlockCheck check = CheckBlock(&block[0], sizes[s], test.offset, test.generation,
+                                          test.seed);
+            const char* name = check.status >= 0 && check.status < BLOCK_STATUSES
+                                   ? BLOCK_STATUS_NAMES[check.status]
+                                   : "unknown";
+            // An intact block must also say where and when it was written
+            bool intact = check.status != BLOCK_CORRUPT;
+            if (strcmp(name, test.name) != 0 ||
+                (intact && (check.foundOffset != OFFSET || check.foundGeneration != GENERATION))) {
+                printf("%d byte block case %d: %s, from offset %lld pass %llu; expected %s\n",
+                       (int)sizes[s], (int)c + 1, name, check.foundOffset, check.foundGeneration,
+                       test.name);
+                ok = false;
+            }
+        }
+    }
+
+    // Neighbouring blocks, and passes over the same block, must differ
+    std::vector<unsigned char> other(4096);
+    FillBlock(&block[0], 4096, OFFSET, GENERATION, SEED);
+    FillBlock(&other[0], 4096, OFFSET + 4096, GENERATION, SEED);
+    bool offsetsDiffer = memcmp(&block[64], &other[64], 4096 - 64) != 0;
+    FillBlock(&other[0], 4096, OFFSET, GENERATION + 1, SEED);
+    if (!offsetsDiffer || memcmp(&block[64], &other[64], 4096 - 64) == 0) {
+        printf("FillBlock payloads repeat across offsets or passes.\n");
+        ok = false;
+    }
+    return ok;
+}
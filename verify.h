@@ -0,0 +1,100 @@
+/*
+ * DiskTest - pattern fill and compare kernels
+ *
+ * The media and signal tests fill 32K blocks with repeating 16-bit
+ * patterns and compare what they read back.  On fast media a word-at-a-
+ * time loop makes that CPU-bound, so there are SSE2 and AVX2 versions of
+ * both, chosen at startup from what the processor supports, with a plain
+ * C++ version for everything else.  Every kernel gives identical results.
+ *
+ * A repeating pattern cannot show where a block came from, so misdirected
+ * or lost writes and stale reads pass unnoticed.  The unique-data test
+ * instead starts every block with a header naming its offset, generation
+ * (pass) and run seed, fills the rest from a generator keyed by those, and
+ * protects the whole block with a CRC32C (the SSE4.2 instruction when
+ * present).  A block that reads back with a good CRC but the wrong header
+ * says exactly which write landed there.
+ */
+
+#ifndef DISKTEST_VERIFY_H
+#define DISKTEST_VERIFY_H
+
+#include <stddef.h>
+
+// Bytes in one repeat of a fill pattern: one AVX2 register
+const int PATTERN_PERIOD = 32;
+
+struct CompareResult {
+    long long firstMismatch; // Byte offset of the first difference, or -1
+    long long badWords;      // 16-bit words that differ
+};
+
+struct VerifyKernel {
+    const char* name;
+    // Fill bytes (a multiple of 2) of dst by repeating period
+    void (*fill)(void* dst, size_t bytes, const unsigned char* period);
+    CompareResult (*compare)(const void* expected, const void* actual, size_t bytes);
+};
+
+// Kernels this processor can run, slowest first; the last is the one used
+const VerifyKernel* VerifyKernels(int& count);
+
+// Fill dst with count 16-bit words repeated (count must divide 16)
+void FillPattern(void* dst, size_t bytes, const unsigned short* words, int count);
+
+// Compare two buffers of bytes (a multiple of 2) word by word
+CompareResult CompareBlocks(const void* expected, const void* actual, size_t bytes);
+
+// CRC32C (Castagnoli) of bytes, continuing from crc (0 to start)
+unsigned int Crc32c(const void* data, size_t bytes, unsigned int crc = 0);
+// Name of the CRC32C version in use
+const char* Crc32cKernel();
+
+// Check the CRC32C against a known answer and the table version, and every
+// fill and compare kernel against the scalar one, on blocks with planted
+// differences.  Prints each failure; true if there were none.
+bool CheckKernels();
+
+const unsigned int BLOCK_MAGIC = 0x4B4C4244; // "DBLK"
+
+// Start of every block written by the unique-data test
+struct BlockHeader {
+    unsigned int magic;
+    unsigned int crc;              // CRC32C of the block after this field
+    unsigned long long offset;     // Where the block was meant to go
+    unsigned long long generation; // Pass that wrote it
+    unsigned long long seed;       // Run that wrote it
+};
+
+enum BlockStatus {
+    BLOCK_GOOD,
+    BLOCK_CORRUPT,   // No header, or the CRC does not match
+    BLOCK_MISPLACED, // Intact, but written for another offset
+    BLOCK_STALE,     // Intact, but from an earlier pass
+    BLOCK_FOREIGN    // Intact, but from another run
+};
+
+const int BLOCK_STATUSES = BLOCK_FOREIGN + 1;
+// Indexed by BlockStatus, for reports
+extern const char* const BLOCK_STATUS_NAMES[BLOCK_STATUSES];
+
+struct BlockCheck {
+    int status;                     // BlockStatus
+    long long foundOffset;          // From the header, if intact
+    unsigned long long foundGeneration;
+};
+
+// Fill a block of bytes (a multiple of 8, at least the header) for offset
+void FillBlock(void* dst, size_t bytes, long long offset, unsigned long long generation,
+               unsigned long long seed);
+
+// Check a block read from offset against what FillBlock would have written
+BlockCheck CheckBlock(const void* src, size_t bytes, long long offset,
+                      unsigned long long generation, unsigned long long seed);
+
+// Round-trip FillBlock and CheckBlock through blocks that are good, damaged,
+// and from the wrong offset, pass and run.  Prints each failure; true if
+// there were none.
+bool CheckBlocks();
+
+#endif // DISKTEST_VERIFY_H
@@ -0,0 +1,639 @@
+/*
+ * DiskTest - workload workers
+ */
+
+#include "worker.h"
+#include "bufferpool.h"
+#include "ioengine.h"
+#include "platform.h"
+#include "random.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Lets every thread finish opening files before any of them starts timing,
+// so the threads really do run concurrently.  stop ends a timed run early.
+struct StartGate {
+    std::atomic<int> ready;
+    std::atomic<int> done;
+    std::atomic<bool> go;
+    std::atomic<bool> failed;
+    std::atomic<bool> stop;
+    long long startTime;
+    long long measureStart; // End of the ramp
+};
+
+// Counted IOs so far, published by each thread once per reap for the
+// progress display and the steady state check
+struct alignas(64) LiveCounters {
+    std::atomic<long long> ops;
+    std::atomic<long long> bytes;
+};
+
+// Flushes shared by the threads of one file, for group commit.  Each
+// request for a flush takes a ticket; a finished flush covers every ticket
+// taken before it started.
+struct CommitGroup {
+    std::mutex lock;
+    std::condition_variable flushed;
+    long long tickets;
+    long long durable;    // Last ticket covered by a finished flush
+    long long failed;     // Last ticket covered by a flush that failed
+    bool flushing;
+};
+
+// Make the writes this thread has completed durable, with one flush of its
+// own or by waiting for the one that covers them.  Counts its own flushes.
+// A thread may wake only after later flushes have finished too, so it fails
+// if the flush that covered its ticket or any later one failed, rather than
+// ever report lost writes as durable.
+static bool Commit(CommitGroup& group, IOEngine* file, bool dataOnly, long long& flushes) {
+    std::unique_lock<std::mutex> hold(group.lock);
+    long long ticket = ++group.tickets;
+    while (group.durable < ticket) {
+        if (group.flushing) {
+            group.flushed.wait(hold);
+            continue;
+        }
+        group.flushing = true;
+        long long covers = group.tickets;
+        hold.unlock();
+        bool ok = file->Flush(dataOnly);
+        flushes++;
+        hold.lock();
+        group.durable = covers;
+        if (!ok) group.failed = covers;
+        group.flushing = false;
+        group.flushed.notify_all();
+    }
+    return ticket > group.failed;
+}
+
+std::string ThreadFileName(const char* path, int index, bool filePerThread) {
+    if (!filePerThread) return path;
+    char name[300];
+    snprintf(name, sizeof(name), "%s.%d", path, index);
+    return name;
+}
+
+// Bytes of file each thread covers, whole blocks so every slice (and every
+// offset in it) stays aligned
+static long long SliceSize(const Workload& w) {
+    long long slice = w.filePerThread ? w.size : w.size / w.threads;
+    return slice - slice % w.blockSize;
+}
+
+bool ParseRate(const char* s, double& iops, double& bytes) {
+    char* end;
+    double value = strtod(s, &end);
+    iops = bytes = 0;
+    if (end == s || value <= 0) return false;
+    double scale = 0;
+    switch (toupper((unsigned char)*end)) {
+    case 'K': scale = 1024.0; end++; break;
+    case 'M': scale = 1024.0 * 1024; end++; break;
+    case 'G': scale = 1024.0 * 1024 * 1024; end++; break;
+    }
+    if (scale > 0 && toupper((unsigned char)*end) == 'B') end++;
+    if (*end != '\0') return false;
+    if (scale > 0) {
+        bytes = value * scale;
+    } else {
+        iops = value;
+    }
+    return true;
+}
+
+// When IO number issued of thread index is due in a rate limited run.  The
+// threads' timelines are staggered so they do not all issue at once.
+static long long DueTime(const StartGate& gate, int index, int threads, long long issued,
+                         double interval) {
+    return gate.startTime + (long long)((issued + (double)index / threads) * interval);
+}
+
+// Samples kept per thread when the run's length is not known in advance
+const size_t DEFAULT_INTERVAL_SAMPLES = 16384;
+const size_t MAX_INTERVAL_SAMPLES = 1 << 20;
+
+// Close the interval ending at end: summarize its IOs into the thread's
+// ring and start the next one empty
+static void CloseInterval(WorkerStats& stats, Histogram& latency, long long& bytes,
+                          long long start, long long end, long long measureStart) {
+    IntervalSample sample;
+    sample.time = (end - measureStart) / 1e9;
+    sample.seconds = (end - start) / 1e9;
+    sample.ops = latency.Count();
+    sample.bytes = bytes;
+    sample.mean = (long long)latency.Mean();
+    sample.p50 = latency.Percentile(50);
+    sample.p99 = latency.Percentile(99);
+    sample.p999 = latency.Percentile(99.9);
+    sample.max = latency.Max();
+    stats.intervals.Add(sample);
+    latency.Reset();
+    bytes = 0;
+}
+
+// Flush the thread's completed writes, through its commit group if it has
+// one, and record the commit latency of those issued after the ramp
+static void SyncWrites(const Workload& w, IOEngine* file, CommitGroup* group,
+                       std::vector<long long>& uncommitted, WorkerStats& stats) {
+    long long flushes = 0;
+    bool ok = group ? Commit(*group, file, w.syncData, flushes) : file->Flush(w.syncData);
+    if (!group) flushes = 1;
+    long long now = ClockNanos();
+    if (!ok) {
+        fprintf(stderr, "Flush error\n");
+        stats.errors++;
+    }
+    for (size_t i = 0; i < uncommitted.size() && ok; i++) {
+        stats.commitLatency.Record(now - uncommitted[i]);
+    }
+    stats.flushes += flushes;
+    uncommitted.clear();
+}
+
+// Thread index of workload w, and number of all the run's threads, pinned
+// to cpu unless that is -1.  commit is the thread's commit group, or NULL;
+// distribution spreads random offsets unless it is NULL (uniform).
+static void Worker(const Workload& w, int index, int number, int cpu, unsigned long long seed,
+                   WorkerStats& stats, LiveCounters& live, StartGate& gate, CommitGroup* commit,
+                   const BlockDistribution* distribution) {
+    stats.cpu = -1;
+    stats.ops = stats.bytes = stats.errors = stats.flushes = 0;
+    stats.elapsed = 0;
+    stats.readLatency.Reset();
+    stats.writeLatency.Reset();
+    stats.commitLatency.Reset();
+    // The ring is sized before the run so recording never allocates
+    long long intervalNanos = (long long)(w.logInterval * 1e9);
+    if (intervalNanos > 0) {
+        size_t capacity = DEFAULT_INTERVAL_SAMPLES;
+        if (w.runtime > 0) capacity = (size_t)(w.runtime / w.logInterval) + 2;
+        if (capacity > MAX_INTERVAL_SAMPLES) capacity = MAX_INTERVAL_SAMPLES;
+        stats.intervals.Reset(capacity);
+    } else {
+        stats.intervals.Reset(0);
+    }
+    live.ops.store(0, std::memory_order_relaxed);
+    live.bytes.store(0, std::memory_order_relaxed);
+
+    if (cpu >= 0 && PinCurrentThread(cpu)) stats.cpu = cpu;
+
+    // Sequential passes cover this thread's slice of the file, wrapping
+    // round in a timed run; random offsets are aligned, within the slice,
+    // or with permute every whole block of the slice once per pass, or
+    // whole blocks drawn from the distribution
+    long long slice = SliceSize(w);
+    long long base = w.offset + (w.filePerThread ? 0 : slice * index);
+    long long blocks = slice / w.blockSize;
+    long long total = w.random ? w.ops : blocks;
+    long long span = (slice - w.blockSize) / w.alignment + 1;
+    Random random(seed);
+    Permutation permutation;
+    if (w.permute) permutation.Init(blocks, random);
+    bool timed = w.runtime > 0;
+    // The write pass always fills the whole file so later tests can read it
+    long long minimum = (w.mode & IO_CREATE) ? blocks : 0;
+
+    std::string path = ThreadFileName(w.path, index, w.filePerThread);
+    // The files have already been created by RunWorkerGroups
+    int mode = w.mode & ~IO_CREATE;
+    if (w.direct) mode |= IO_DIRECT;
+    if (w.dsync) mode |= IO_DSYNC;
+    std::unique_ptr<IOEngine> file(CreateEngine(w.engine, w.queueDepth));
+    bool opened = file && file->Open(path.c_str(), mode);
+
+    // One aligned transfer buffer per request slot
+    int depth = opened ? file->QueueDepth() : 1;
+    BufferPool ownPool;
+    BufferPool& pool = w.buffers && number < MAX_THREADS ? w.buffers->pools[number] : ownPool;
+    if (opened && !pool.Fits(depth, w.blockSize, w.alignment) &&
+        !pool.Allocate(depth, w.blockSize, w.alignment)) {
+        fprintf(stderr, "Out of memory for transfer buffers\n");
+        opened = false;
+    }
+    std::vector<IORequest> requests(depth);
+    std::vector<IORequest*> idle(depth);
+    std::vector<void*> slots(depth);
+    for (int i = 0; i < depth && opened; i++) {
+        slots[i] = pool.Slot(i);
+        requests[i].buffer = slots[i];
+        requests[i].bufferIndex = i;
+        idle[i] = &requests[i];
+    }
+    if (opened && !file->RegisterBuffers(slots.data(), depth, (long)pool.SlotSize())) {
+        for (int i = 0; i < depth; i++) requests[i].bufferIndex = -1;
+    }
+
+    if (!opened) gate.failed = true;
+    gate.ready++;
+    while (!gate.go) std::this_thread::yield();
+    if (gate.failed) {
+        gate.done++;
+        return;
+    }
+
+    int n = 1;
+    int limit = w.readPercent / 10;
+    std::vector<IORequest*> batch(depth);
+    long long issued = 0;    // Every IO, ramp included
+    long long measured = 0;  // IOs issued after the ramp
+    long long end = gate.measureStart + (long long)(w.runtime * 1e9);
+    bool more = true;
+    Histogram intervalLatency;
+    long long intervalBytes = 0;
+    long long intervalEnd = gate.measureStart + intervalNanos;
+    // Nanoseconds between this thread's IOs when rate limited
+    double interval = w.rate > 0 ? w.threads * 1e9 / w.rate : 0;
+    long long due = interval > 0 ? DueTime(gate, index, w.threads, 0, interval) : 0;
+    // Writes completed since the last flush, and the issue times of those
+    // after the ramp
+    int unsynced = 0;
+    std::vector<long long> uncommitted;
+    uncommitted.reserve(w.syncEvery + depth);
+
+    // Keep up to depth requests in flight until the count or time is up
+    while (more || (int)idle.size() < depth) {
+        // One clock read per batch and per reap keeps timing overhead off
+        // the individual IOs
+        long long now = ClockNanos();
+        bool warming = now < gate.measureStart;
+        if (issued >= minimum && (gate.stop || (timed && now >= end))) more = false;
+
+        int count = 0;
+        while (more && !idle.empty()) {
+            if (!timed && !warming && measured >= total && issued >= minimum) {
+                more = false;
+                break;
+            }
+            if (interval > 0 && due > now) break; // Not yet
+
+            IORequest* request = idle.back();
+            idle.pop_back();
+            request->length = w.blockSize;
+            if (!w.random) {
+                request->offset = base + (issued % blocks) * w.blockSize;
+            } else if (w.permute) {
+                request->offset = base + (long long)permutation.Next() * w.blockSize;
+            } else if (distribution) {
+                long long block = (long long)distribution->Next(random, issued);
+                request->offset = base + block * w.blockSize;
+            } else {
+                request->offset = base + (long long)random.Below(span) * w.alignment;
+            }
+            request->write = n > limit; // Reads first, then writes, in each 10
+            // Rate limited latency counts from when the IO was due
+            request->issueTime = interval > 0 ? due : now;
+            batch[count++] = request;
+            issued++;
+            if (request->issueTime >= gate.measureStart) measured++;
+            if (interval > 0) due = DueTime(gate, index, w.threads, issued, interval);
+
+            n++;
+            if (n > 10) n = 1;
+        }
+        int submitted = count > 0 ? file->Submit(batch.data(), count) : 0;
+        if (submitted != count) {
+            // Those not accepted were never queued; stop, and drain the rest
+            fprintf(stderr, "Submit error\n");
+            stats.errors++;
+            for (int i = submitted < 0 ? 0 : submitted; i < count; i++) idle.push_back(batch[i]);
+            more = false;
+        }
+        if ((int)idle.size() == depth) {
+            if (interval > 0 && more) WaitUntil(due);
+            continue;
+        }
+
+        // Rate limited with a slot free, only poll, so the next IO is not
+        // held up waiting for this one
+        bool poll = interval > 0 && more && !idle.empty();
+        int done = file->Reap(batch.data(), poll ? 0 : 1, depth);
+        if (done == 0) std::this_thread::yield();
+        if (done < 0) {
+            fprintf(stderr, "I/O completion error\n");
+            stats.errors++;
+            break;
+        }
+        now = ClockNanos();
+        // Completions count in the interval they were reaped in; any that
+        // passed with none are logged empty, which is what a stall looks like
+        while (intervalNanos > 0 && now >= intervalEnd) {
+            CloseInterval(stats, intervalLatency, intervalBytes, intervalEnd - intervalNanos,
+                          intervalEnd, gate.measureStart);
+            intervalEnd += intervalNanos;
+        }
+        for (int i = 0; i < done; i++) {
+            IORequest* request = batch[i];
+            idle.push_back(request);
+            if (request->write && w.syncEvery > 0) unsynced++;
+            if (request->issueTime < gate.measureStart) continue; // Ramp
+            if (request->result < 0) {
+                stats.errors++;
+            } else {
+                stats.bytes += request->result;
+                intervalBytes += request->result;
+            }
+            long long latency = now - request->issueTime;
+            if (request->write) {
+                stats.writeLatency.Record(latency);
+                if (w.syncEvery > 0) {
+                    if (request->result >= 0) uncommitted.push_back(request->issueTime);
+                } else if (w.dsync) {
+                    stats.commitLatency.Record(latency);
+                }
+            } else {
+                stats.readLatency.Record(latency);
+            }
+            if (intervalNanos > 0) intervalLatency.Record(latency);
+            stats.ops++;
+        }
+        if (w.syncEvery > 0 && unsynced >= w.syncEvery) {
+            SyncWrites(w, file.get(), commit, uncommitted, stats);
+            unsynced = 0;
+        }
+        live.ops.store(stats.ops, std::memory_order_relaxed);
+        live.bytes.store(stats.bytes, std::memory_order_relaxed);
+    }
+
+    // The last writes are committed within the run
+    if (unsynced > 0) SyncWrites(w, file.get(), commit, uncommitted, stats);
+
+    long long finish = ClockNanos();
+    if (finish > gate.measureStart) stats.elapsed = (finish - gate.measureStart) / 1e9;
+    // The last, partial interval
+    if (intervalNanos > 0 && finish > intervalEnd - intervalNanos) {
+        CloseInterval(stats, intervalLatency, intervalBytes, intervalEnd - intervalNanos, finish,
+                      gate.measureStart);
+    }
+    file->Close();
+    gate.done++;
+}
+
+bool ReserveBuffers(WorkerBuffers& buffers, int threads, int depth, int blockSize,
+                    int alignment) {
+    for (int t = 0; t < threads && t < MAX_THREADS; t++) {
+        BufferPool& pool = buffers.pools[t];
+        if (!pool.Fits(depth, blockSize, alignment) && !pool.Allocate(depth, blockSize, alignment)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the last count samples all lie within tolerance percent of their mean
+static bool Converged(const std::vector<double>& samples, int count, double tolerance) {
+    double sum = 0, low = samples.back(), high = samples.back();
+    for (size_t i = samples.size() - count; i < samples.size(); i++) {
+        sum += samples[i];
+        if (samples[i] < low) low = samples[i];
+        if (samples[i] > high) high = samples[i];
+    }
+    double mean = sum / count;
+    return mean > 0 && high - low <= mean * tolerance / 100;
+}
+
+// Watch the threads' counters (every group's) from the calling thread until
+// they finish; the steady state settings are the first group's.
+// With progress on, show the IOPS and throughput of each PROGRESS_SECONDS.
+// With steady state detection on, sample every tenth of a window, and once
+// IOPS and throughput over the last window have each stayed within
+// tolerance percent of their mean, tell the threads to stop.  Returns
+// seconds after the ramp that happened, or 0 if the threads finished first.
+static double MonitorWorkers(const Workload& w, bool progress, std::vector<LiveCounters>& live,
+                             StartGate& gate) {
+    const int SAMPLES = 10;
+    const double PROGRESS_SECONDS = 0.5;
+    bool steady = w.steadyTolerance > 0;
+    long long interval = (long long)(w.steadyWindow * 1e9 / SAMPLES);
+    if (interval < 1000000) interval = 1000000;
+    long long showInterval = (long long)(PROGRESS_SECONDS * 1e9);
+
+    std::unique_ptr<ProgressLine> line(progress ? new ProgressLine() : NULL);
+    std::vector<double> iops, throughput;
+    long long lastOps = 0, lastBytes = 0, shownOps = 0, shownBytes = 0;
+    long long next = gate.measureStart + interval;
+    long long nextShow = gate.startTime + showInterval;
+    long long lastShow = gate.startTime;
+    int threads = (int)live.size();
+    while (gate.done < threads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(steady ? 1 : 5));
+        long long now = ClockNanos();
+        if (now < next && now < nextShow) continue;
+
+        long long ops = 0, bytes = 0;
+        for (int t = 0; t < threads; t++) {
+            ops += live[t].ops.load(std::memory_order_relaxed);
+            bytes += live[t].bytes.load(std::memory_order_relaxed);
+        }
+
+        if (line && now >= nextShow) {
+            char text[64];
+            // Counted IOs only began at the end of the ramp
+            long long from = lastShow > gate.measureStart ? lastShow : gate.measureStart;
+            double seconds = (now - from) / 1e9;
+            if (now < gate.measureStart) {
+                snprintf(text, sizeof(text), "[ramp %.0f s]",
+                         (gate.measureStart - now) / 1e9 + 0.5);
+            } else {
+                snprintf(text, sizeof(text), "[%.0f IOPS, %.2f MB/s]",
+                         (ops - shownOps) / seconds,
+                         (bytes - shownBytes) / seconds / (1024 * 1024));
+            }
+            line->Show(text);
+            shownOps = ops;
+            shownBytes = bytes;
+            lastShow = now;
+            nextShow = now + showInterval;
+        }
+
+        if (!steady || now < next) continue;
+        double seconds = (now - next + interval) / 1e9;
+        iops.push_back((ops - lastOps) / seconds);
+        throughput.push_back((bytes - lastBytes) / seconds);
+        lastOps = ops;
+        lastBytes = bytes;
+        next = now + interval;
+
+        if ((int)iops.size() < SAMPLES) continue;
+        if (Converged(iops, SAMPLES, w.steadyTolerance) &&
+            Converged(throughput, SAMPLES, w.steadyTolerance)) {
+            gate.stop = true;
+            return (now - gate.measureStart) / 1e9;
+        }
+    }
+    return 0;
+}
+
+// Apply the defaults and limits to a copy of a workload
+static Workload Normalize(const Workload& workload) {
+    Workload w = workload;
+    if (w.threads < 1) w.threads = 1;
+    if (w.blockSize > MAX_TRANSFER) w.blockSize = MAX_TRANSFER;
+    if (w.alignment < 1) w.alignment = 512;
+    if (w.steadyWindow <= 0) w.steadyWindow = 5;
+    if (w.rate <= 0 && w.rateBytes > 0) w.rate = w.rateBytes / w.blockSize;
+    if (w.logInterval < 0) w.logInterval = 0;
+    if (w.syncEvery < 0) w.syncEvery = 0;
+    return w;
+}
+
+// Create (truncate) a workload's files, and allocate their space if asked,
+// before the threads open them.  Engines that cannot extend a file need it
+// sized, which their own Preallocate does.
+static bool CreateFiles(Workload& w) {
+    std::unique_ptr<IOEngine> probe(CreateEngine(w.engine, 1));
+    bool extends = !probe || probe->CanExtend();
+    int files = w.filePerThread ? w.threads : 1;
+    long long length = w.offset + (w.filePerThread ? w.size : SliceSize(w) * w.threads);
+    for (int t = 0; t < files; t++) {
+        std::string path = ThreadFileName(w.path, t, w.filePerThread);
+        std::unique_ptr<IOEngine> file(CreateEngine(extends ? NULL : w.engine));
+        if (!file->Open(path.c_str(), IO_READ | IO_WRITE | IO_CREATE)) return false;
+        if (!extends && !file->Preallocate(length)) {
+            fprintf(stderr, "Cannot size %s for the %s engine\n", path.c_str(), w.engine);
+            return false;
+        }
+        if (extends && w.preallocate && !file->Preallocate(length)) {
+            fprintf(stderr, "Preallocation is not supported here; continuing without\n");
+            w.preallocate = false;
+        }
+        file->Close();
+    }
+    return true;
+}
+
+bool RunWorkers(const Workload& workload, std::vector<WorkerStats>& stats, RunResult& result) {
+    std::vector<Workload> groups(1, workload);
+    std::vector<RunResult> results;
+    bool ok = RunWorkerGroups(groups, stats, results);
+    result = results[0];
+    return ok;
+}
+
+bool RunWorkerGroups(const std::vector<Workload>& workloads, std::vector<WorkerStats>& stats,
+                     std::vector<RunResult>& results) {
+    std::vector<Workload> groups(workloads.size());
+    int threads = 0;
+    for (size_t g = 0; g < workloads.size(); g++) {
+        groups[g] = Normalize(workloads[g]);
+        threads += groups[g].threads;
+    }
+    results.assign(groups.size(), RunResult());
+    for (size_t g = 0; g < groups.size(); g++) {
+        if ((groups[g].mode & IO_CREATE) && !CreateFiles(groups[g])) return false;
+    }
+
+    // Each thread gets its own offset stream, all derived from its group's
+    // seed (and the group number, so groups given one seed still differ)
+    std::vector<unsigned long long> seeds;
+    for (size_t g = 0; g < groups.size(); g++) {
+        unsigned long long state = groups[g].seed + g;
+        for (int t = 0; t < groups[g].threads; t++) {
+            seeds.push_back(SplitMix64(state));
+        }
+    }
+
+    stats.assign(threads, WorkerStats());
+    std::vector<LiveCounters> live(threads);
+    StartGate gate;
+    gate.ready = 0;
+    gate.done = 0;
+    gate.go = false;
+    gate.failed = false;
+    gate.stop = false;
+
+    // Group commit is among the threads of one file
+    std::vector<std::unique_ptr<CommitGroup> > commits(groups.size());
+    for (size_t g = 0; g < groups.size(); g++) {
+        const Workload& w = groups[g];
+        if (!w.groupCommit || w.syncEvery == 0 || w.filePerThread) continue;
+        commits[g].reset(new CommitGroup());
+        commits[g]->tickets = commits[g]->durable = commits[g]->failed = 0;
+        commits[g]->flushing = false;
+    }
+
+    // Every thread's slice has the same number of blocks, so one table serves
+    // the whole group
+    std::vector<std::unique_ptr<BlockDistribution> > distributions(groups.size());
+    for (size_t g = 0; g < groups.size(); g++) {
+        const Workload& w = groups[g];
+        if (!w.random || w.permute || w.distribution.kind == DIST_UNIFORM) continue;
+        distributions[g].reset(new BlockDistribution());
+        unsigned long long key = w.seed + g;
+        distributions[g]->Init(w.distribution, SliceSize(w) / w.blockSize, SplitMix64(key));
+    }
+
+    // Threads are numbered across the groups for pinning, one per CPU in turn
+    std::vector<std::thread> pool;
+    int first = 0;
+    for (size_t g = 0; g < groups.size(); g++) {
+        for (int t = 0; t < groups[g].threads; t++) {
+            int n = first + t;
+            int cpu = threads > 1 ? n % CpuCount() : -1;
+            pool.push_back(std::thread(Worker, std::cref(groups[g]), t, n, cpu, seeds[n],
+                                       std::ref(stats[n]), std::ref(live[n]), std::ref(gate),
+                                       commits[g].get(), distributions[g].get()));
+        }
+        first += groups[g].threads;
+    }
+    while (gate.ready < threads) std::this_thread::yield();
+    long long minorFaults, majorFaults;
+    QueryPageFaults(minorFaults, majorFaults);
+    gate.startTime = ClockNanos();
+    gate.measureStart = gate.startTime + (long long)(groups[0].ramp * 1e9);
+    gate.go = true;
+
+    // Progress is drawn only where it can be redrawn in place
+    const Workload& w = groups[0];
+    bool progress = w.progress && IsConsole();
+    double steadyAfter = 0;
+    if ((progress || w.steadyTolerance > 0) && !gate.failed) {
+        steadyAfter = MonitorWorkers(w, progress, live, gate);
+    }
+
+    for (size_t t = 0; t < pool.size(); t++) {
+        pool[t].join();
+    }
+    long long minor, major;
+    QueryPageFaults(minor, major);
+
+    // Faults are only known for the whole process
+    first = 0;
+    for (size_t g = 0; g < groups.size(); g++) {
+        RunResult& result = results[g];
+        result.steadyAfter = steadyAfter;
+        result.minorFaults = minor - minorFaults;
+        result.majorFaults = major - majorFaults;
+        result.elapsed = 0;
+        for (int t = first; t < first + groups[g].threads; t++) {
+            if (stats[t].elapsed > result.elapsed) result.elapsed = stats[t].elapsed;
+        }
+        if (result.elapsed <= 0) result.elapsed = 0.01; // Prevent division by zero
+        first += groups[g].threads;
+    }
+    return !gate.failed;
+}
+
+WorkerStats MergeStats(const std::vector<WorkerStats>& stats) {
+    WorkerStats total = WorkerStats();
+    total.cpu = -1;
+    for (size_t t = 0; t < stats.size(); t++) {
+        total.ops += stats[t].ops;
+        total.bytes += stats[t].bytes;
+        total.errors += stats[t].errors;
+        total.flushes += stats[t].flushes;
+        if (stats[t].elapsed > total.elapsed) total.elapsed = stats[t].elapsed;
+        total.readLatency.Merge(stats[t].readLatency);
+        total.writeLatency.Merge(stats[t].writeLatency);
+        total.commitLatency.Merge(stats[t].commitLatency);
+    }
+    return total;
+}
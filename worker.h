@@ -0,0 +1,136 @@
+/*
+ * DiskTest - workload workers
+ *
+ * A Workload describes one test pass: the file to use, transfer size,
+ * read/write mix, sequential or random access and queue depth.  RunWorkers
+ * runs it on one or more threads, each with its own slice of the file (or
+ * its own file), and returns a WorkerStats per thread, including a latency
+ * histogram of every read and write.  Each thread only ever writes its own
+ * stats, so no locking is needed; the caller merges them once every thread
+ * has finished.
+ *
+ * A workload normally runs a fixed number of IOs, or runs for a fixed time
+ * if runtime is set.  IOs completed during the ramp are not counted, and
+ * with steadyTolerance set the run stops early once throughput settles.
+ *
+ * Normally each thread keeps its queue full.  With a rate set the run is
+ * open loop instead: every IO has a due time on a fixed timeline, is issued
+ * then if a request slot is free, and has its latency measured from when it
+ * was due.  An IO held up behind a slow one is charged for the wait, so the
+ * latency reported is what a client issuing at that rate would see, not
+ * just the time the disk spent on the IOs that did get issued.
+ *
+ * Writes normally stop at the OS cache.  With syncEvery set each thread
+ * flushes its file after every syncEvery writes complete, and a write
+ * counts as committed when the flush after it finishes; with dsync every
+ * write is committed when it completes.  Commit latency, from submission
+ * to durability, is what a database's log writer waits for.  With
+ * groupCommit the threads sharing a file also share flushes: a thread
+ * needing one waits for a flush that started after its writes completed,
+ * or starts one itself if none is running, so one flush commits the
+ * writes of every thread waiting on it.
+ */
+
+#ifndef DISKTEST_WORKER_H
+#define DISKTEST_WORKER_H
+
+#include "bufferpool.h"
+#include "distribution.h"
+#include "histogram.h"
+#include "timeseries.h"
+#include <string>
+#include <vector>
+
+const int MAX_THREADS = 64;
+
+// Largest transfer a workload may use
+const int MAX_TRANSFER = 4 * 1024 * 1024;
+
+// Each thread's transfer buffers, kept from one run to the next so a series
+// of runs (a block size sweep) allocates and faults in its memory once.  A
+// thread reallocates its pool only if it is too small for the run.
+struct WorkerBuffers {
+    BufferPool pools[MAX_THREADS];
+};
+
+// Grow the first threads pools, where needed, to depth slots of blockSize bytes
+bool ReserveBuffers(WorkerBuffers& buffers, int threads, int depth, int blockSize,
+                    int alignment);
+
+struct Workload {
+    const char* path;
+    int mode;             // IO_READ / IO_WRITE / IO_CREATE
+    const char* engine;   // NULL or "" for the native engine
+    int queueDepth;
+    int blockSize;
+    int readPercent;      // Of each 10 IOs, the first readPercent / 10 are reads
+    bool random;
+    long long offset;     // Start of the region of the file to cover
+    long long size;       // Bytes of region to cover, split between threads
+    long long ops;        // Random IOs per thread (sequential: size / blockSize)
+    int threads;
+    bool filePerThread;   // Each thread gets its own file of size bytes
+    bool direct;          // Open with IO_DIRECT
+    bool preallocate;     // With IO_CREATE, allocate the files' space up front
+    int alignment;        // Random offsets are multiples of this
+    bool permute;         // Random offsets visit every block once per pass
+    DistributionSpec distribution; // How random offsets are spread, if not permuted
+    unsigned long long seed; // Random offsets are the same for the same seed
+    bool progress;        // Show live IOPS and throughput on the console
+    double runtime;       // Seconds to run after the ramp, or 0 to run ops / size
+    double ramp;          // Seconds of warm-up whose IOs are not counted
+    double steadyTolerance; // Stop once IOPS stays within this % of its mean, 0 for off
+    double steadyWindow;  // Seconds of history the steady state check looks at
+    double rate;          // IOs per second across all threads, 0 for flat out
+    double rateBytes;     // Or, if rate is 0, bytes per second
+    WorkerBuffers* buffers; // Transfer buffers to reuse, or NULL for the run's own
+    double logInterval;   // Seconds per IntervalSample, 0 to keep none
+    int syncEvery;        // Flush after every syncEvery writes, 0 for never
+    bool syncData;        // Flush with fdatasync rather than fsync
+    bool dsync;           // Open with IO_DSYNC
+    bool groupCommit;     // Threads on one file share flushes
+};
+
+// Padded to a cache line so neighbouring threads never share one
+struct alignas(64) WorkerStats {
+    int cpu;              // CPU the thread was pinned to, or -1
+    long long ops;
+    long long bytes;
+    long long errors;
+    double elapsed;       // Seconds from the end of the ramp to this thread's end
+    Histogram readLatency;  // Nanoseconds from submission to completion
+    Histogram writeLatency;
+    Histogram commitLatency; // Writes, from submission until durable
+    long long flushes;
+    IntervalRing intervals; // With logInterval set, the run interval by interval
+};
+
+struct RunResult {
+    double elapsed;       // Seconds from the end of the ramp until the last thread finished
+    double steadyAfter;   // Seconds after the ramp steady state was reached, or 0
+    long long minorFaults; // Page faults taken by the process during the run
+    long long majorFaults;
+};
+
+// Run the workload and fill in one WorkerStats per thread.  Returns false if
+// any thread could not open its file.
+bool RunWorkers(const Workload& workload, std::vector<WorkerStats>& stats, RunResult& result);
+
+// Sum of the per-thread counters
+WorkerStats MergeStats(const std::vector<WorkerStats>& stats);
+
+// Parse a rate= value: a plain number is IOs per second, a number with a K,
+// M or G suffix (and optional B) is bytes per second
+bool ParseRate(const char* s, double& iops, double& bytes);
+
+// Run several workloads at once, each on its own group of threads (one
+// group per target, say), all starting together.  stats gets every group's
+// threads in turn; results one RunResult per group.  Ramp, progress and
+// steady state settings are taken from the first workload.
+bool RunWorkerGroups(const std::vector<Workload>& workloads, std::vector<WorkerStats>& stats,
+                     std::vector<RunResult>& results);
+
+// File used by thread index of a workload
+std::string ThreadFileName(const char* path, int index, bool filePerThread);
+
+#endif // DISKTEST_WORKER_H